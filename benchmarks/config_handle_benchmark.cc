@@ -0,0 +1,60 @@
+/**
+ * @brief Measures the per-request cost of pushing a Configuration to a
+ * handle, once with every option pushed and once with only changed options
+ * pushed.
+ *
+ */
+
+#include <chrono>
+#include <cstdio>
+
+#include <curl/curl.h>
+
+#include "swish/swish.h"
+
+namespace {
+
+constexpr int kIterations = 1000000;
+
+template <typename Setup>
+double NanosecondsPerCall(Setup&& setup) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) setup();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         kIterations;
+}
+
+}  // namespace
+
+int main() {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+
+  swish::Configuration configuration{};
+  configuration.user_agent = "swish-benchmark/1.0";
+  configuration.timeout = std::chrono::milliseconds{5000};
+  configuration.follow_redirection = true;
+  configuration.authentication_credentials.authentication_type =
+      swish::Authentication::Basic;
+  configuration.authentication_credentials.username = "user";
+  configuration.authentication_credentials.password = "password";
+  configuration.proxy.host = "http://127.0.0.1:3128";
+  configuration.header.Emplace("Accept", "application/json");
+  configuration.header.Emplace("X-Request-Source", "benchmark");
+  configuration.session_cookie = swish::MemoryCookie{"Set-Cookie: id=1"};
+
+  CURL* handle = curl_easy_init();
+
+  double all = NanosecondsPerCall([&] { configuration.ConfigHandle(handle); });
+
+  swish::AppliedConfiguration applied{};
+  double changed = NanosecondsPerCall(
+      [&] { configuration.ConfigHandle(handle, &applied); });
+
+  std::printf("every option pushed:  %8.1f ns/request\n", all);
+  std::printf("changed options only: %8.1f ns/request\n", changed);
+
+  curl_easy_cleanup(handle);
+  curl_global_cleanup();
+}
@@ -0,0 +1,607 @@
+#ifndef ______lib_SWISH___async_h
+#define ______lib_SWISH___async_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+// coroutine support requires C++20 and epoll
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>) && \
+    defined(__linux__)
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "client.h"
+
+#define SWISH_HAS_COROUTINES 1
+
+namespace swish {
+
+// state shared between a suspended request and the reactor completing it
+struct AsyncOperation {
+  std::coroutine_handle<> continuation{};
+  StatusCode status = StatusCode::OK;
+  // watch of the transfer, resumed by the reactor if its governor paused it
+  TransferWatch* watch = nullptr;
+  // records the attempt made on the handle that ended with the status, and
+  // returns how long to wait before the next one if it is retried
+  std::function<std::optional<std::chrono::milliseconds>(CURL*, StatusCode)>
+      retry{};
+};
+
+/**
+ * @brief Event loop driving transfers with curl_multi_socket_action on an
+ * epoll instance. Suspended requests are resumed from within Run() and
+ * RunOnce() on the thread calling them.
+ *
+ */
+class Reactor {
+  CURLM* multi_handle_ = nullptr;
+  int epoll_fd_ = -1;
+
+  bool timer_set_ = false;
+  std::chrono::steady_clock::time_point deadline_{};
+
+  size_t pending_ = 0;
+
+  // transfers shaped by a bandwidth governor, they may be paused by it
+  std::vector<std::pair<CURL*, TransferWatch*>> governed_{};
+
+  // failed transfers waiting to be attempted again, and when
+  std::vector<std::pair<std::chrono::steady_clock::time_point, CURL*>>
+      retries_{};
+
+  static int SocketCallback(CURL*, curl_socket_t socket, int what,
+                            void* user_data, void* socket_data) {
+    auto* reactor = static_cast<Reactor*>(user_data);
+
+    if (what == CURL_POLL_REMOVE) {
+      epoll_ctl(reactor->epoll_fd_, EPOLL_CTL_DEL, socket, nullptr);
+      curl_multi_assign(reactor->multi_handle_, socket, nullptr);
+      return 0;
+    }
+
+    epoll_event event{};
+    event.data.fd = socket;
+    if (what & CURL_POLL_IN) event.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT) event.events |= EPOLLOUT;
+
+    if (socket_data == nullptr) {
+      epoll_ctl(reactor->epoll_fd_, EPOLL_CTL_ADD, socket, &event);
+      // any non-null value marks the socket as registered
+      curl_multi_assign(reactor->multi_handle_, socket, reactor);
+    } else {
+      epoll_ctl(reactor->epoll_fd_, EPOLL_CTL_MOD, socket, &event);
+    }
+
+    return 0;
+  }
+
+  static int TimerCallback(CURLM*, long timeout_ms, void* user_data) {
+    auto* reactor = static_cast<Reactor*>(user_data);
+
+    reactor->timer_set_ = timeout_ms >= 0;
+    reactor->deadline_ = std::chrono::steady_clock::now() +
+                         std::chrono::milliseconds{timeout_ms};
+    return 0;
+  }
+
+  // unpauses governed transfers whose traffic class has budget again, returns
+  // how long until the next one may be resumed
+  std::chrono::milliseconds ResumeThrottled() {
+    auto wait = std::chrono::milliseconds::max();
+
+    for (auto& [handle, watch] : governed_) {
+      auto delay = watch->ResumeThrottled();
+      if (delay == TransferWatch::clock::duration::max()) continue;
+      wait = std::min(
+          wait, std::max(std::chrono::ceil<std::chrono::milliseconds>(delay),
+                         std::chrono::milliseconds{1}));
+    }
+
+    return wait;
+  }
+
+  static AsyncOperation* Operation(CURL* handle) {
+    AsyncOperation* operation = nullptr;
+    curl_easy_getinfo(handle, CURLINFO_PRIVATE, &operation);
+    return operation;
+  }
+
+  // resumes the request of [handle], whose transfer ended with [status]
+  void Complete(CURL* handle, StatusCode status) {
+    AsyncOperation* operation = Operation(handle);
+    pending_--;
+
+    if (operation->watch != nullptr && operation->watch->governed()) {
+      auto governed = std::find(governed_.begin(), governed_.end(),
+                                std::make_pair(handle, operation->watch));
+      if (governed != governed_.end()) governed_.erase(governed);
+    }
+
+    operation->status = status;
+    operation->continuation.resume();
+  }
+
+  // adds back the transfers due for another attempt on their handle, returns
+  // how long until the next one is due
+  std::chrono::milliseconds StartRetries() {
+    auto wait = std::chrono::milliseconds::max();
+    auto now = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < retries_.size();) {
+      auto [due, handle] = retries_[i];
+      if (due > now) {
+        wait = std::min(wait, std::chrono::ceil<std::chrono::milliseconds>(
+                                  due - now));
+        i++;
+        continue;
+      }
+
+      retries_[i] = retries_.back();
+      retries_.pop_back();
+
+      if (curl_multi_add_handle(multi_handle_, handle) != CURLM_OK)
+        Complete(handle, StatusCode::InitializationError);
+    }
+
+    return wait;
+  }
+
+  // resumes every request whose transfer is done, or sets it aside for
+  // another attempt
+  void Dispatch() {
+    CURLMsg* message = nullptr;
+    int queued = 0;
+
+    while ((message = curl_multi_info_read(multi_handle_, &queued)) !=
+           nullptr) {
+      if (message->msg != CURLMSG_DONE) continue;
+
+      // message is invalidated by curl_multi_remove_handle
+      CURL* handle = message->easy_handle;
+      StatusCode status = static_cast<StatusCode>(message->data.result);
+
+      curl_multi_remove_handle(multi_handle_, handle);
+
+      AsyncOperation* operation = Operation(handle);
+      std::optional<std::chrono::milliseconds> delay{};
+      if (operation->retry) delay = operation->retry(handle, status);
+
+      if (!delay.has_value()) {
+        Complete(handle, status);
+        continue;
+      }
+
+      retries_.emplace_back(std::chrono::steady_clock::now() + *delay, handle);
+    }
+  }
+
+ public:
+  Reactor()
+      : multi_handle_(curl_multi_init()), epoll_fd_(epoll_create1(0)) {
+    assert(multi_handle_ != nullptr);
+    assert(epoll_fd_ != -1);
+
+    curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+    curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi_handle_, CURLMOPT_TIMERFUNCTION, TimerCallback);
+    curl_multi_setopt(multi_handle_, CURLMOPT_TIMERDATA, this);
+  }
+
+  /**
+   * @brief starts the transfer on [handle], [operation] is resumed once done.
+   * CURLOPT_PRIVATE of [handle] is taken by the reactor
+   */
+  StatusCode Add(CURL* handle, AsyncOperation* operation) {
+    StatusCode status = static_cast<StatusCode>(
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, operation));
+    if (!IsOK(status)) return status;
+
+    if (curl_multi_add_handle(multi_handle_, handle) != CURLM_OK)
+      return StatusCode::InitializationError;
+
+    pending_++;
+    if (operation->watch != nullptr && operation->watch->governed())
+      governed_.emplace_back(handle, operation->watch);
+
+    return StatusCode::OK;
+  }
+
+  /**
+   * @brief waits at most [max_wait] for socket activity or a libcurl timeout
+   * and resumes the requests that completed
+   *
+   */
+  void RunOnce(std::chrono::milliseconds max_wait) {
+    // resuming or retrying a transfer arms the timer
+    auto wait = std::min({max_wait, ResumeThrottled(), StartRetries()});
+
+    if (timer_set_) {
+      auto until_deadline =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              deadline_ - std::chrono::steady_clock::now());
+      wait = std::clamp(until_deadline, std::chrono::milliseconds{0}, wait);
+    }
+
+    epoll_event events[64];
+    int ready = epoll_wait(epoll_fd_, events, 64, static_cast<int>(wait.count()));
+
+    int running = 0;
+
+    for (int i = 0; i < ready; i++) {
+      int action = 0;
+      if (events[i].events & EPOLLIN) action |= CURL_CSELECT_IN;
+      if (events[i].events & EPOLLOUT) action |= CURL_CSELECT_OUT;
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) action |= CURL_CSELECT_ERR;
+
+      curl_multi_socket_action(multi_handle_, events[i].data.fd, action,
+                               &running);
+    }
+
+    if (timer_set_ && std::chrono::steady_clock::now() >= deadline_) {
+      timer_set_ = false;
+      curl_multi_socket_action(multi_handle_, CURL_SOCKET_TIMEOUT, 0, &running);
+    }
+
+    Dispatch();
+  }
+
+  // runs until no request is in flight
+  void Run() {
+    while (pending_ > 0) RunOnce(std::chrono::milliseconds{1000});
+  }
+
+  // number of requests in flight, including those waiting to be retried
+  size_t pending() const { return pending_; }
+
+  CURLM* multi_handle() { return multi_handle_; }
+
+  Reactor(const Reactor&) = delete;
+
+  Reactor& operator=(const Reactor&) = delete;
+
+  Reactor(Reactor&&) = delete;
+
+  Reactor& operator=(Reactor&&) = delete;
+
+  // every request must have completed before the reactor is destroyed
+  ~Reactor() noexcept {
+    curl_multi_cleanup(multi_handle_);
+    close(epoll_fd_);
+  }
+};
+
+/**
+ * @brief HTTP client whose requests are awaitable from C++20 coroutines, e.g.
+ *
+ *   auto [response, status] = co_await client.GetAsync(url);
+ *
+ * The awaiting coroutine is suspended until the transfer is done and resumed
+ * by [reactor]. Every request uses [configuration] as it is when awaited.
+ * Failed requests are attempted again under its retry policy, the reactor
+ * waits out the backoff between attempts without blocking.
+ */
+template <typename RxByteType = char,
+          typename RxByteTraits = std::char_traits<RxByteType>,
+          typename RxAllocator = std::allocator<RxByteType>>
+class BasicAsyncClient {
+ public:
+  using rx_byte_type = RxByteType;
+  using rx_byte_traits = RxByteTraits;
+  using rx_allocator_t = RxAllocator;
+  using response_buff_t =
+      BasicResponseBuffer<rx_byte_type, rx_byte_traits, rx_allocator_t>;
+  using response_t = Response<response_buff_t>;
+  using rx_str_t =
+      std::basic_string<rx_byte_type, rx_byte_traits, rx_allocator_t>;
+
+ private:
+  enum class Method { Get, Head, Delete, Post, Download };
+
+  Reactor* reactor_ = nullptr;
+
+  // finished handles are reset and reused by later requests rather than
+  // allocated again, responses own their fields
+  std::vector<CURL*> idle_handles_{};
+
+  CURL* AcquireHandle() {
+    if (idle_handles_.empty()) return curl_easy_init();
+
+    CURL* handle = idle_handles_.back();
+    idle_handles_.pop_back();
+    curl_easy_reset(handle);
+    return handle;
+  }
+
+  // detaches [handle] from its share first, whose state is only kept alive
+  // while the transfer lasts
+  void ReleaseHandle(CURL* handle) {
+    curl_easy_setopt(handle, CURLOPT_SHARE, nullptr);
+    idle_handles_.push_back(handle);
+  }
+
+ public:
+  /**
+   * @brief Awaitable request, resumes with the response and status of the
+   * transfer
+   *
+   */
+  class Request {
+    BasicAsyncClient* client_ = nullptr;
+    Method method_ = Method::Get;
+    std::string url_{};
+    RequestBody post_data_{};
+    rx_str_t* target_ = nullptr;
+
+    CURL* handle_ = nullptr;
+    response_buff_t body_{};
+    ResponseHeaderBuffer header_{};
+    ResponseHeaderContext<response_buff_t> header_context_{};
+    AsyncOperation operation_{};
+    // header lists the handle points to, kept alive if the configuration's
+    // headers change before the transfer is done
+    std::shared_ptr<curl_slist> request_header_{};
+    std::shared_ptr<curl_slist> proxy_header_{};
+    // share the handle is attached to, kept alive the same way
+    std::shared_ptr<SharedState> shared_state_{};
+    // records the outcome of every attempt in the metrics registry and circuit
+    // breaker and decides on retries, set once the transfer was started
+    RetryController attempts_{};
+    uint32_t response_fields_ = kAllResponseFields;
+    TransferWatch watch_{TransferWatch::Driver::Multi};
+
+    Request(BasicAsyncClient* client, Method method, std::string_view url)
+        : client_{client}, method_{method}, url_{url} {}
+
+    StatusCode ConfigMethod() {
+      StatusCode status = StatusCode::OK;
+
+      switch (method_) {
+        case Method::Head:
+          status = static_cast<StatusCode>(
+              curl_easy_setopt(handle_, CURLOPT_NOBODY, 1L));
+          break;
+        case Method::Delete:
+          status = static_cast<StatusCode>(
+              curl_easy_setopt(handle_, CURLOPT_CUSTOMREQUEST, "DELETE"));
+          break;
+        case Method::Post:
+          status = post_data_.ConfigHandle(handle_);
+          break;
+        default:
+          break;
+      }
+      if (!IsOK(status)) return status;
+
+      if (method_ == Method::Download) {
+        status = static_cast<StatusCode>(
+            curl_easy_setopt(handle_, CURLOPT_WRITEFUNCTION,
+                             ResponseBodyStringCallback<rx_str_t>));
+        if (!IsOK(status)) return status;
+
+        return static_cast<StatusCode>(
+            curl_easy_setopt(handle_, CURLOPT_WRITEDATA, target_));
+      }
+
+      header_context_ = {&header_, &body_};
+
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(handle_, CURLOPT_HEADERFUNCTION,
+                           ResponseHeaderReserveCallback<response_buff_t>));
+      if (!IsOK(status)) return status;
+
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(handle_, CURLOPT_HEADERDATA, &header_context_));
+      if (!IsOK(status)) return status;
+
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(handle_, CURLOPT_WRITEFUNCTION,
+                           ResponseBufferCallback<response_buff_t>));
+      if (!IsOK(status)) return status;
+
+      return static_cast<StatusCode>(
+          curl_easy_setopt(handle_, CURLOPT_WRITEDATA, &body_));
+    }
+
+    StatusCode Start() {
+      RetryController attempts{client_->configuration.retry_policy,
+                               client_->configuration.circuit_breaker, url_,
+                               client_->configuration.metrics};
+      if (!attempts.Admit()) return StatusCode::CircuitOpen;
+
+      handle_ = client_->AcquireHandle();
+      if (handle_ == nullptr) return StatusCode::InitializationError;
+
+      body_ = response_buff_t{client_->configuration.response_buffer};
+      response_fields_ = client_->configuration.response_fields;
+
+      StatusCode status = client_->configuration.ConfigHandle(handle_);
+      if (!IsOK(status)) return status;
+      request_header_ = client_->configuration.header.shared_slist();
+      proxy_header_ = client_->configuration.proxy.header.shared_slist();
+      shared_state_ = client_->configuration.shared_state;
+
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(handle_, CURLOPT_URL, url_.c_str()));
+      if (!IsOK(status)) return status;
+
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(handle_, CURLOPT_HEADERFUNCTION,
+                           ResponseBufferCallback<ResponseHeaderBuffer>));
+      if (!IsOK(status)) return status;
+
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(handle_, CURLOPT_HEADERDATA, &header_));
+      if (!IsOK(status)) return status;
+
+      status = ConfigMethod();
+      if (!IsOK(status)) return status;
+
+      status = client_->configuration.Watch(handle_, &watch_);
+      if (!IsOK(status)) return status;
+      operation_.watch = &watch_;
+      // the request is not moved once awaited
+      operation_.retry = [this](CURL* handle, StatusCode status) {
+        return Retry(handle, status);
+      };
+
+      attempts_ = attempts;
+      return client_->reactor_->Add(handle_, &operation_);
+    }
+
+    // readies the request for another attempt if the one made on [handle]
+    // that ended with [status] is retried, a body downloaded into a target
+    // is only retried if none of it was received
+    std::optional<std::chrono::milliseconds> Retry(CURL* handle,
+                                                   StatusCode status) {
+      auto delay = attempts_.Next(handle, status, header_,
+                                  method_ == Method::Download);
+      if (!delay.has_value()) return delay;
+
+      body_ = response_buff_t{body_.options()};
+      header_.Clear();
+      watch_.Restart();
+      return delay;
+    }
+
+    friend class BasicAsyncClient;
+
+   public:
+    bool await_ready() const noexcept { return false; }
+
+    // does not suspend if the transfer could not be started
+    bool await_suspend(std::coroutine_handle<> continuation) {
+      operation_.continuation = continuation;
+      operation_.status = Start();
+      return IsOK(operation_.status);
+    }
+
+    std::pair<response_t, StatusCode> await_resume() {
+      response_t response{};
+
+      if (handle_ != nullptr) {
+        watch_.Finish(operation_.status);
+        response.Prepare(handle_, std::move(body_), std::move(header_),
+                         response_fields_);
+        response.throughput_ = watch_.throughput();
+        client_->ReleaseHandle(handle_);
+        handle_ = nullptr;
+      }
+
+      return std::make_pair(std::move(response), operation_.status);
+    }
+
+    Request(const Request&) = delete;
+
+    Request& operator=(const Request&) = delete;
+
+    Request(Request&&) = default;
+
+    Request& operator=(Request&&) = default;
+  };
+
+  Configuration configuration{};
+
+  explicit BasicAsyncClient(Reactor* reactor) : reactor_{reactor} {
+    assert(reactor_ != nullptr);
+  }
+
+  /**
+   * @brief Performs a GET request and stores the response body in a vector of
+   * buffers
+   *
+   */
+  Request GetAsync(std::string_view url) {
+    return Request{this, Method::Get, url};
+  }
+
+  /**
+   * @brief Performs a HEAD request
+   *
+   */
+  Request HeadAsync(std::string_view url) {
+    return Request{this, Method::Head, url};
+  }
+
+  /**
+   * @brief Performs a DELETE request
+   *
+   */
+  Request DeleteAsync(std::string_view url) {
+    return Request{this, Method::Delete, url};
+  }
+
+  /**
+   * @brief Performs a POST request with [data] as its body, memory [data]
+   * does not own must outlive the request
+   *
+   */
+  Request PostAsync(std::string_view url, RequestBody data) {
+    Request request{this, Method::Post, url};
+    request.post_data_ = std::move(data);
+    return request;
+  }
+
+  /**
+   * @brief Performs a GET request and stores the response body in [target]
+   *
+   */
+  Request DownloadAsync(std::string_view url, rx_str_t* target) {
+    Request request{this, Method::Download, url};
+    request.target_ = target;
+    return request;
+  }
+
+  BasicAsyncClient(const BasicAsyncClient&) = delete;
+
+  BasicAsyncClient& operator=(const BasicAsyncClient&) = delete;
+
+  // every request must have completed before the client is destroyed
+  ~BasicAsyncClient() noexcept {
+    for (CURL* handle : idle_handles_) curl_easy_cleanup(handle);
+  }
+};
+
+typedef BasicAsyncClient<char> AsyncClient;
+
+};  // namespace swish
+
+#endif
+
+#endif
@@ -53,6 +53,13 @@ struct Credentials {
   std::string username{};
   std::string password{};
 
+  bool operator==(const Credentials& other) const {
+    return authentication_type == other.authentication_type &&
+           username == other.username && password == other.password;
+  }
+
+  bool operator!=(const Credentials& other) const { return !(*this == other); }
+
   friend struct Configuration;
 
  private:
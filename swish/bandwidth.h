@@ -0,0 +1,249 @@
+#ifndef ______lib_SWISH___bandwidth_h
+#define ______lib_SWISH___bandwidth_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+namespace swish {
+
+// priority of a transfer's traffic under a BandwidthGovernor
+enum class TrafficClass : uint32_t { Interactive = 0, Bulk = 1 };
+
+class BandwidthShare;
+
+/**
+ * @brief Token bucket shaping the combined throughput of every transfer
+ * attached to it, across clients and threads.
+ *
+ * The budget of [bytes_per_second] is split between the traffic classes with
+ * transfers in flight in proportion to their weights, a class alone on the
+ * link gets all of it. Each class may run [burst_bytes] ahead of its share,
+ * the refill a class leaves unused past that goes to the classes still
+ * short of it, so an idle interactive request does not hold bulk transfers
+ * back. Transfers over their class's budget are paused until it refills.
+ *
+ * A rate of 0 leaves transfers unlimited.
+ */
+class BandwidthGovernor {
+ public:
+  using clock = std::chrono::steady_clock;
+
+ private:
+  struct Class {
+    uint32_t weight = 1;
+    // transfers of the class in flight
+    uint32_t active = 0;
+    // bytes the class may still transfer, negative when in debt
+    double balance = 0;
+  };
+
+  static constexpr size_t class_count = 2;
+
+  mutable std::mutex mutex_{};
+  double rate_ = 0;
+  double burst_ = 0;
+  std::array<Class, class_count> classes_{};
+  clock::time_point last_refill_{clock::now()};
+
+  static size_t Index(TrafficClass traffic_class) {
+    return static_cast<size_t>(traffic_class);
+  }
+
+  // weight of the classes in flight that use their share, a class whose
+  // balance is full leaves its share to the others
+  uint32_t DrainingWeight() const {
+    uint32_t weight = 0;
+    for (const Class& entry : classes_)
+      if (entry.active > 0 && entry.balance < burst_) weight += entry.weight;
+    return weight;
+  }
+
+  void Refill(clock::time_point now) {
+    double seconds = std::chrono::duration<double>(now - last_refill_).count();
+    last_refill_ = now;
+    if (seconds <= 0) return;
+
+    // what a class can not hold past its burst is split again between the
+    // classes still short of it
+    double refill = rate_ * seconds;
+    for (size_t round = 0; round < class_count && refill > 0; round++) {
+      uint32_t weight = DrainingWeight();
+      if (weight == 0) return;
+
+      double spilled = 0;
+      for (Class& entry : classes_) {
+        if (entry.active == 0 || entry.balance >= burst_) continue;
+        entry.balance += refill * entry.weight / weight;
+        if (entry.balance > burst_) {
+          spilled += entry.balance - burst_;
+          entry.balance = burst_;
+        }
+      }
+      refill = spilled;
+    }
+  }
+
+  friend class BandwidthShare;
+
+  void Join(TrafficClass traffic_class) {
+    std::lock_guard lock{mutex_};
+    Refill(clock::now());
+    classes_[Index(traffic_class)].active++;
+  }
+
+  void Leave(TrafficClass traffic_class) {
+    std::lock_guard lock{mutex_};
+    Refill(clock::now());
+    classes_[Index(traffic_class)].active--;
+  }
+
+  // debits [bytes] from the class and returns how long its transfers must
+  // wait before going on, zero if they need not
+  clock::duration Consume(TrafficClass traffic_class, uint64_t bytes) {
+    std::lock_guard lock{mutex_};
+    if (rate_ <= 0) return clock::duration::zero();
+
+    Refill(clock::now());
+
+    Class& entry = classes_[Index(traffic_class)];
+    entry.balance -= static_cast<double>(bytes);
+    if (entry.balance >= 0) return clock::duration::zero();
+
+    uint32_t weight = std::max(DrainingWeight(), entry.weight);
+    double class_rate = rate_ * entry.weight / weight;
+    return std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(-entry.balance / class_rate));
+  }
+
+ public:
+  /**
+   * @brief [burst_bytes] defaults to a tenth of a second worth of
+   * [bytes_per_second]
+   *
+   */
+  explicit BandwidthGovernor(uint64_t bytes_per_second = 0,
+                             uint64_t burst_bytes = 0) {
+    classes_[Index(TrafficClass::Interactive)].weight = 8;
+    classes_[Index(TrafficClass::Bulk)].weight = 1;
+    SetRate(bytes_per_second, burst_bytes);
+  }
+
+  // process-wide governor, unlimited until its rate is set
+  static BandwidthGovernor& Global() {
+    static BandwidthGovernor governor{};
+    return governor;
+  }
+
+  void SetRate(uint64_t bytes_per_second, uint64_t burst_bytes = 0) {
+    std::lock_guard lock{mutex_};
+    Refill(clock::now());
+    rate_ = static_cast<double>(bytes_per_second);
+    burst_ = burst_bytes > 0 ? static_cast<double>(burst_bytes) : rate_ / 10;
+    for (Class& entry : classes_) entry.balance = std::min(entry.balance, burst_);
+  }
+
+  // share of the budget [traffic_class] gets relative to the other classes
+  // in flight, at least 1
+  void SetWeight(TrafficClass traffic_class, uint32_t weight) {
+    std::lock_guard lock{mutex_};
+    Refill(clock::now());
+    classes_[Index(traffic_class)].weight = std::max(weight, 1u);
+  }
+
+  uint64_t rate() const {
+    std::lock_guard lock{mutex_};
+    return static_cast<uint64_t>(rate_);
+  }
+
+  BandwidthGovernor(const BandwidthGovernor&) = delete;
+
+  BandwidthGovernor& operator=(const BandwidthGovernor&) = delete;
+};
+
+/**
+ * @brief A transfer's place in its BandwidthGovernor's traffic class, held
+ * while the transfer is in flight.
+ *
+ */
+class BandwidthShare {
+  BandwidthGovernor* governor_ = nullptr;
+  TrafficClass traffic_class_ = TrafficClass::Interactive;
+
+ public:
+  using clock = BandwidthGovernor::clock;
+
+  BandwidthShare() = default;
+
+  BandwidthShare(BandwidthGovernor* governor, TrafficClass traffic_class)
+      : governor_{governor}, traffic_class_{traffic_class} {
+    if (governor_ != nullptr) governor_->Join(traffic_class_);
+  }
+
+  bool attached() const { return governor_ != nullptr; }
+
+  TrafficClass traffic_class() const { return traffic_class_; }
+
+  /**
+   * @brief accounts for [bytes] transferred and returns how long the transfer
+   * must be paused for, zero if it may go on
+   *
+   */
+  clock::duration Consume(uint64_t bytes) {
+    if (governor_ == nullptr) return clock::duration::zero();
+    return governor_->Consume(traffic_class_, bytes);
+  }
+
+  // leaves the governor, the transfer is done
+  void Release() {
+    if (governor_ != nullptr) governor_->Leave(traffic_class_);
+    governor_ = nullptr;
+  }
+
+  BandwidthShare(const BandwidthShare&) = delete;
+
+  BandwidthShare& operator=(const BandwidthShare&) = delete;
+
+  BandwidthShare(BandwidthShare&& other) noexcept
+      : governor_{std::exchange(other.governor_, nullptr)},
+        traffic_class_{other.traffic_class_} {}
+
+  BandwidthShare& operator=(BandwidthShare&& other) noexcept {
+    std::swap(governor_, other.governor_);
+    std::swap(traffic_class_, other.traffic_class_);
+    return *this;
+  }
+
+  ~BandwidthShare() noexcept { Release(); }
+};
+
+};  // namespace swish
+
+#endif
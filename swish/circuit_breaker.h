@@ -0,0 +1,308 @@
+#ifndef ______lib_SWISH___circuit_breaker_h
+#define ______lib_SWISH___circuit_breaker_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <curl/curl.h>
+
+#include "http.h"
+#include "status_codes.h"
+
+namespace swish {
+
+class CircuitBreakers;
+
+struct CircuitBreakerPolicy {
+  bool enabled = false;
+
+  // calls are judged over this rolling window
+  std::chrono::milliseconds window{10000};
+
+  // calls in the window needed before the circuit may open
+  uint32_t minimum_calls = 20;
+
+  // the circuit opens once this fraction of the calls in the window failed,
+  // transport errors, timeouts and 5xx responses count as failures
+  double failure_rate = 0.5;
+
+  // or once this fraction of them took [slow_call_duration] or longer
+  double slow_call_rate = 0.8;
+  std::chrono::milliseconds slow_call_duration{5000};
+
+  // requests fail with StatusCode::CircuitOpen for this long once it opens
+  std::chrono::milliseconds open_duration{30000};
+
+  // trial requests let through once [open_duration] is over, the circuit
+  // closes if all of them succeed and opens again on the first that does not
+  uint32_t half_open_calls = 3;
+
+  // breakers of every host, the process-wide ones if null
+  CircuitBreakers* breakers = nullptr;
+};
+
+/**
+ * @brief Circuit breaker of one host.
+ *
+ * Closed, requests go through and their outcomes are counted over a rolling
+ * window of ten buckets. Open, requests fail right away without being sent.
+ * Half open, a few trial requests go through to tell whether the host
+ * recovered.
+ */
+class CircuitBreaker {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  enum class State { Closed, Open, HalfOpen };
+
+ private:
+  struct Bucket {
+    // index of the span of time counted, buckets are reused once it passed
+    int64_t span = -1;
+    uint32_t calls = 0;
+    uint32_t failures = 0;
+    uint32_t slow_calls = 0;
+  };
+
+  static constexpr size_t bucket_count = 10;
+
+  mutable std::mutex mutex_{};
+  State state_ = State::Closed;
+  std::array<Bucket, bucket_count> buckets_{};
+  clock::time_point open_until_{};
+  uint32_t trials_started_ = 0;
+  uint32_t trials_succeeded_ = 0;
+  clock::time_point trials_since_{};
+
+  static int64_t Span(const CircuitBreakerPolicy& policy, clock::time_point now) {
+    auto width = std::max<int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(policy.window)
+                .count() /
+            static_cast<int64_t>(bucket_count),
+        1);
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               now.time_since_epoch())
+               .count() /
+           width;
+  }
+
+  void Open(const CircuitBreakerPolicy& policy, clock::time_point now) {
+    state_ = State::Open;
+    open_until_ = now + policy.open_duration;
+    buckets_ = {};
+  }
+
+  // counts the call in the window and returns whether the circuit must open
+  bool Count(const CircuitBreakerPolicy& policy, clock::time_point now,
+             bool failed, bool slow) {
+    int64_t span = Span(policy, now);
+
+    Bucket& bucket = buckets_[span % bucket_count];
+    if (bucket.span != span) bucket = Bucket{span};
+    bucket.calls++;
+    bucket.failures += failed;
+    bucket.slow_calls += slow;
+
+    uint32_t calls = 0, failures = 0, slow_calls = 0;
+    for (const Bucket& entry : buckets_) {
+      if (entry.span <= span - static_cast<int64_t>(bucket_count)) continue;
+      calls += entry.calls;
+      failures += entry.failures;
+      slow_calls += entry.slow_calls;
+    }
+
+    if (calls == 0 || calls < policy.minimum_calls) return false;
+    return failures >= policy.failure_rate * calls ||
+           slow_calls >= policy.slow_call_rate * calls;
+  }
+
+ public:
+  CircuitBreaker() = default;
+
+  // whether a request may be sent now
+  bool Allow(const CircuitBreakerPolicy& policy) {
+    std::lock_guard lock{mutex_};
+
+    clock::time_point now = clock::now();
+
+    // trials that were never recorded do not hold the circuit half open
+    bool trials_lapsed = state_ == State::HalfOpen &&
+                         now >= trials_since_ + policy.open_duration;
+
+    if ((state_ == State::Open && now >= open_until_) || trials_lapsed) {
+      state_ = State::HalfOpen;
+      trials_started_ = 0;
+      trials_succeeded_ = 0;
+      trials_since_ = now;
+    }
+
+    if (state_ == State::Open) return false;
+
+    if (state_ == State::HalfOpen) {
+      if (trials_started_ >= policy.half_open_calls) return false;
+      trials_started_++;
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief counts the outcome of a request that was allowed, [status] and
+   * [response_code] telling whether it failed and [duration] whether it was
+   * slow
+   *
+   */
+  void Record(const CircuitBreakerPolicy& policy, StatusCode status,
+              long response_code, std::chrono::microseconds duration) {
+    bool failed = Failed(status, response_code);
+    bool slow = duration >= policy.slow_call_duration;
+    clock::time_point now = clock::now();
+
+    std::lock_guard lock{mutex_};
+
+    switch (state_) {
+      case State::Closed:
+        if (Count(policy, now, failed, slow)) Open(policy, now);
+        break;
+
+      case State::HalfOpen:
+        if (failed || slow) {
+          Open(policy, now);
+        } else if (++trials_succeeded_ >= policy.half_open_calls) {
+          state_ = State::Closed;
+        }
+        break;
+
+      // sent before the circuit opened
+      case State::Open:
+        break;
+    }
+  }
+
+  // counts the finished transfer of [handle] that ended with [status]
+  void Record(const CircuitBreakerPolicy& policy, CURL* handle,
+              StatusCode status) {
+    long response_code = 0;
+    curl_off_t total = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response_code);
+    curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+    Record(policy, status, response_code, std::chrono::microseconds{total});
+  }
+
+  State state() const {
+    std::lock_guard lock{mutex_};
+    return state_;
+  }
+
+  // failures the host is to blame for: transport errors, timeouts and 5xx
+  // responses. Errors of the caller, e.g. a malformed url, do not count
+  static bool Failed(StatusCode status, long response_code) {
+    switch (status) {
+      case StatusCode::OK:
+        return response_code >= 500;
+      case StatusCode::HostResolutionError:
+      case StatusCode::ConnectionError:
+      case StatusCode::TimedOut:
+      case StatusCode::SSL_ConnectionError:
+      case StatusCode::SendError:
+      case StatusCode::ReceiveError:
+      case StatusCode::NoServerResponse:
+      case StatusCode::PartialFile:
+      case StatusCode::HTTP2Error:
+      case StatusCode::HTTP2StreamError:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  CircuitBreaker(const CircuitBreaker&) = delete;
+
+  CircuitBreaker& operator=(const CircuitBreaker&) = delete;
+};
+
+/**
+ * @brief Circuit breakers by host, created on first use and kept for the
+ * lifetime of the registry.
+ *
+ */
+class CircuitBreakers {
+  mutable std::mutex mutex_{};
+  std::map<std::string, std::unique_ptr<CircuitBreaker>, std::less<>>
+      breakers_{};
+
+ public:
+  CircuitBreakers() = default;
+
+  static CircuitBreakers& Global() {
+    static CircuitBreakers breakers{};
+    return breakers;
+  }
+
+  // breaker of [host], e.g. example.com:443
+  CircuitBreaker& ForHost(std::string_view host) {
+    std::lock_guard lock{mutex_};
+
+    auto breaker = breakers_.find(host);
+    if (breaker == breakers_.end())
+      breaker = breakers_
+                    .emplace(std::string{host},
+                             std::make_unique<CircuitBreaker>())
+                    .first;
+
+    return *breaker->second;
+  }
+
+  /**
+   * @brief breaker of the host of [url] under [policy], null if the policy
+   * is disabled
+   *
+   */
+  static CircuitBreaker* For(const CircuitBreakerPolicy& policy,
+                             std::string_view url) {
+    if (!policy.enabled) return nullptr;
+
+    CircuitBreakers& breakers =
+        policy.breakers != nullptr ? *policy.breakers : Global();
+    return &breakers.ForHost(http::UrlHost(url));
+  }
+
+  CircuitBreakers(const CircuitBreakers&) = delete;
+
+  CircuitBreakers& operator=(const CircuitBreakers&) = delete;
+};
+
+};  // namespace swish
+
+#endif
@@ -36,15 +36,20 @@
 #include <chrono>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <numeric>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <utility>
 
 #include <curl/curl.h>
 
 #include "config.h"
 #include "default_callbacks.h"
+#include "file_sink.h"
 #include "request.h"
+#include "request_stream.h"
 #include "response.h"
 #include "status_codes.h"
 
@@ -62,6 +67,241 @@ typedef hackery::MultipartFormData<Client> MultipartFormData;
 class Client {
   CURL* curl_handle_ = nullptr;
 
+  // options of [configuration] last pushed to the handle
+  AppliedConfiguration applied_configuration_{};
+
+  // share the handle is attached to, kept alive until the handle is detached
+  // from it even if [configuration] no longer points to it
+  std::shared_ptr<SharedState> shared_state_{};
+
+  // body of the POST request being performed, if it is streamed
+  RequestStream* request_stream_ = nullptr;
+
+  // drives hedged requests, its connections are kept for the next ones
+  CURLM* hedge_multi_ = nullptr;
+
+  HedgeDelays hedge_delays_{};
+
+  StatusCode Perform() {
+    if (request_stream_ != nullptr)
+      return request_stream_->Perform(curl_handle_);
+
+    return static_cast<StatusCode>(curl_easy_perform(curl_handle_));
+  }
+
+  /**
+   * @brief performs the transfer with [attempt] and watched by [watch],
+   * attempting it again on the same handle while the retry policy allows.
+   * [discard] empties the response body received before another attempt.
+   *
+   * Attempts are only made while the circuit breaker of the host of [url]
+   * allows, the request fails with StatusCode::CircuitOpen if the first one
+   * is not.
+   *
+   * [streamed_body] the response body is handed on as it arrives and can not
+   * be discarded
+   */
+  template <typename Attempt, typename Discard>
+  StatusCode Perform(std::string_view url, TransferWatch* watch,
+                     ResponseHeaderBuffer* header, bool streamed_body,
+                     Attempt&& attempt, Discard&& discard) {
+    // a streamed request body is consumed by its first attempt
+    RetryController attempts{
+        request_stream_ == nullptr ? configuration.retry_policy : RetryPolicy{},
+        configuration.circuit_breaker, url, configuration.metrics};
+
+    if (!attempts.Admit()) {
+      watch->Finish(StatusCode::CircuitOpen);
+      return StatusCode::CircuitOpen;
+    }
+
+    // a hedge may replace the handle during an attempt
+    StatusCode status = attempts.Perform(
+        attempt, [this] { return curl_handle_; }, *header, streamed_body,
+        [&] {
+          discard();
+          header->Clear();
+          watch->Restart();
+        });
+
+    watch->Finish(status);
+    return status;
+  }
+
+  /**
+   * @brief performs the transfer of [url], sending a duplicate of it on a
+   * second handle if no first byte arrived within the hedge policy's delay.
+   * The first to complete successfully wins, the other is aborted. The
+   * winner is left as the client's handle and followed by [watch], its
+   * response in [context].
+   *
+   */
+  template <typename ResponseBuffer>
+  StatusCode PerformHedged(std::string_view url,
+                           ResponseHeaderContext<ResponseBuffer>* context,
+                           TransferWatch* watch) {
+    using clock = std::chrono::steady_clock;
+
+    const HedgePolicy& policy = configuration.hedge_policy;
+
+    if (hedge_multi_ == nullptr) hedge_multi_ = curl_multi_init();
+    if (hedge_multi_ == nullptr ||
+        curl_multi_add_handle(hedge_multi_, curl_handle_) != CURLM_OK)
+      return Perform();
+
+    // a throttled transfer is paused rather than held within its callback,
+    // which would hold the other handle back too
+    watch->SetDriver(TransferWatch::Driver::Multi);
+
+    if (policy.budget != nullptr) policy.budget->Deposit();
+    clock::time_point deadline =
+        clock::now() + hedge_delays_.Get(policy, configuration.metrics,
+                                         http::UrlHost(url));
+
+    ResponseBuffer hedge_body{context->body->options()};
+    ResponseHeaderBuffer hedge_header{};
+    ResponseHeaderContext<ResponseBuffer> hedge_context{&hedge_header,
+                                                        &hedge_body};
+
+    CURL* hedge = nullptr;
+    bool may_hedge = true;
+    bool primary_running = true;
+    bool hedge_running = false;
+
+    CURL* winner = nullptr;
+    StatusCode status = StatusCode::OK;
+
+    while (winner == nullptr) {
+      int running = 0;
+      curl_multi_perform(hedge_multi_, &running);
+
+      CURLMsg* message = nullptr;
+      int queued = 0;
+      while (winner == nullptr &&
+             (message = curl_multi_info_read(hedge_multi_, &queued)) !=
+                 nullptr) {
+        if (message->msg != CURLMSG_DONE) continue;
+
+        CURL* done = message->easy_handle;
+        StatusCode result = static_cast<StatusCode>(message->data.result);
+        curl_multi_remove_handle(hedge_multi_, done);
+
+        bool& running_flag = done == curl_handle_ ? primary_running
+                                                  : hedge_running;
+        bool& other_running = done == curl_handle_ ? hedge_running
+                                                   : primary_running;
+        running_flag = false;
+
+        // a failure only ends the request if the other one can not win
+        if (IsOK(result) || !other_running) {
+          winner = done;
+          status = result;
+        }
+      }
+
+      if (winner != nullptr) break;
+
+      clock::time_point now = clock::now();
+
+      if (may_hedge && primary_running && now >= deadline) {
+        may_hedge = false;
+
+        // not hedged if its first byte came in time
+        if (context->header->total_size() == 0 &&
+            (policy.budget == nullptr || policy.budget->Withdraw())) {
+          hedge = StartHedge(&hedge_context);
+          hedge_running = hedge != nullptr;
+        }
+      }
+
+      auto wait = std::chrono::milliseconds{1000};
+      if (may_hedge)
+        wait = std::clamp(
+            std::chrono::ceil<std::chrono::milliseconds>(deadline - now),
+            std::chrono::milliseconds{0}, wait);
+
+      auto throttled = watch->ResumeThrottled();
+      if (throttled != TransferWatch::clock::duration::max())
+        wait = std::min(
+            wait,
+            std::max(std::chrono::ceil<std::chrono::milliseconds>(throttled),
+                     std::chrono::milliseconds{1}));
+
+      curl_multi_poll(hedge_multi_, nullptr, 0, static_cast<int>(wait.count()),
+                      nullptr);
+    }
+
+    // the loser is aborted
+    if (primary_running) curl_multi_remove_handle(hedge_multi_, curl_handle_);
+    if (hedge_running) curl_multi_remove_handle(hedge_multi_, hedge);
+
+    watch->SetDriver(TransferWatch::Driver::Easy);
+
+    if (winner == hedge) {
+      std::swap(curl_handle_, hedge);
+      std::swap(*context->body, hedge_body);
+      std::swap(*context->header, hedge_header);
+
+      // the next attempts of the request are made on the winner
+      curl_easy_setopt(curl_handle_, CURLOPT_WRITEDATA, context->body);
+      curl_easy_setopt(curl_handle_, CURLOPT_HEADERDATA, context);
+      curl_easy_setopt(curl_handle_, CURLOPT_NOPROGRESS,
+                       applied_configuration_.progress_enabled ? 0L : 1L);
+      watch->Rebind(curl_handle_);
+
+      // the options recorded as applied were pushed to the handle it replaces
+      applied_configuration_.valid = false;
+    }
+
+    if (hedge != nullptr) curl_easy_cleanup(hedge);
+
+    return status;
+  }
+
+  // duplicates the client's handle into a hedge writing its response into
+  // [context], null if it could not be started. It may replace the client's
+  // handle, so it is given the shared state and cookies duplication drops
+  template <typename ResponseBuffer>
+  CURL* StartHedge(ResponseHeaderContext<ResponseBuffer>* context) {
+    CURL* hedge = curl_easy_duphandle(curl_handle_);
+    if (hedge == nullptr) return nullptr;
+
+    CURLSH* share = configuration.shared_state == nullptr
+                        ? nullptr
+                        : configuration.shared_state->share_handle();
+
+    curl_slist* cookies = nullptr;
+    curl_easy_getinfo(curl_handle_, CURLINFO_COOKIELIST, &cookies);
+
+    bool copied = curl_easy_setopt(hedge, CURLOPT_SHARE, share) == CURLE_OK;
+
+    // the cookie engine of the duplicate is only started by a cookie file
+    bool cookies_used = cookies != nullptr ||
+                        configuration.session_cookie != Cookie{} ||
+                        !configuration.cookie_file_storage.empty();
+    if (copied && cookies_used)
+      copied = curl_easy_setopt(hedge, CURLOPT_COOKIEFILE, "") == CURLE_OK;
+
+    for (curl_slist* cookie = cookies; copied && cookie != nullptr;
+         cookie = cookie->next)
+      copied = curl_easy_setopt(hedge, CURLOPT_COOKIELIST, cookie->data) ==
+               CURLE_OK;
+    curl_slist_free_all(cookies);
+
+    // the transfer watch follows the original request only
+    if (!copied ||
+        curl_easy_setopt(hedge, CURLOPT_WRITEDATA, context->body) !=
+            CURLE_OK ||
+        curl_easy_setopt(hedge, CURLOPT_HEADERDATA, context) != CURLE_OK ||
+        curl_easy_setopt(hedge, CURLOPT_NOPROGRESS, 1L) != CURLE_OK ||
+        curl_multi_add_handle(hedge_multi_, hedge) != CURLM_OK) {
+      curl_easy_cleanup(hedge);
+      return nullptr;
+    }
+
+    return hedge;
+  }
+
  public:
   Configuration configuration{};
 
@@ -71,7 +311,8 @@ class Client {
    * @brief Sends a POST request of Content-Type:
    * application/x-www-form-urlencoded
    *
-   * [FormData] FormData type to use for form data fields in the POST request
+   * [FormData] FormData type to use for form data fields in the POST request,
+   * any range of key/value pairs. Strings are posted as they are
    * [RxByteType] Type of byte to be sent to the server, char, uint8, int8, etc
    * [RxByteTraits] The char_traits of the byte type
    * [RxAllocator] Allocator for server response headers and buffers
@@ -79,7 +320,8 @@ class Client {
    */
   template <typename FormDataT = FormData, typename RxByteType = char,
             typename RxByteTraits = std::char_traits<RxByteType>,
-            typename RxAllocator = std::allocator<RxByteType>>
+            typename RxAllocator = std::allocator<RxByteType>,
+            typename = std::enable_if_t<is_form_data<FormDataT>::value>>
 
   std::pair<
       Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>,
@@ -89,28 +331,10 @@ class Client {
     using response_t =
         Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>;
 
-    std::string post_data{};
-
     if (!(post_fields.size() > 0))
       throw std::range_error{"Post Fields can not be empty"};
 
-    using post_t = FormDataT;
-
-    std::vector<std::string> keys{};
-    std::vector<std::string> values{};
-
-    for (const auto& kv : post_fields) keys.push_back(kv.first);
-    for (const auto& kv : post_fields) values.push_back(kv.second);
-
-    for (auto i = 0; i < (keys.size() - 1); i++) {
-      post_data.append(keys[i]);
-      post_data.append("=");
-      post_data.append(values[i]);
-      post_data.append("&");
-    }
-    post_data.append(keys.back());
-    post_data.append("=");
-    post_data.append(values.back());
+    std::string post_data = JoinFormData(post_fields);
 
     StatusCode config_status = StatusCode::OK;
 
@@ -126,7 +350,8 @@ class Client {
     if (!IsOK(config_status))
       return std::make_pair(response_t{}, config_status);
 
-    auto [resp, status] = Get<RxByteType, RxByteTraits, RxAllocator>(url);
+    auto [resp, status] =
+        Fetch<RxByteType, RxByteTraits, RxAllocator>(url, false);
 
     // expect no error
     curl_easy_setopt(curl_handle_, CURLOPT_POSTFIELDSIZE, -1);
@@ -138,6 +363,45 @@ class Client {
     return std::make_pair(std::move(resp), status);
   }
 
+  /**
+   * @brief Sends a POST request with [body] as its request body, the bytes are
+   * handed to libcurl in place and must stay valid for the call
+   *
+   */
+  template <typename RxByteType = char,
+            typename RxByteTraits = std::char_traits<RxByteType>,
+            typename RxAllocator = std::allocator<RxByteType>>
+
+  std::pair<
+      Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>,
+      StatusCode>
+  Post(std::string_view url, const RequestBody& body) {
+    using response_t =
+        Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>;
+
+    StatusCode config_status = body.ConfigHandle(curl_handle_);
+    if (!IsOK(config_status))
+      return std::make_pair(response_t{}, config_status);
+
+    auto [resp, status] =
+        Fetch<RxByteType, RxByteTraits, RxAllocator>(url, false);
+
+    // expect no error
+    curl_easy_setopt(curl_handle_, CURLOPT_POSTFIELDSIZE_LARGE,
+                     static_cast<curl_off_t>(-1));
+    curl_easy_setopt(curl_handle_, CURLOPT_POSTFIELDS, nullptr);
+
+    // default
+    curl_easy_setopt(curl_handle_, CURLOPT_HTTPGET, true);
+
+    return std::make_pair(std::move(resp), status);
+  }
+
+  /**
+   * @brief Sends a POST request with [data] as its request body, without
+   * copying it
+   *
+   */
   template <typename FormDataT = FormData, typename RxByteType = char,
             typename RxByteTraits = std::char_traits<RxByteType>,
             typename RxAllocator = std::allocator<RxByteType>,
@@ -149,44 +413,51 @@ class Client {
       Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>,
       StatusCode>
   Post(std::string_view url,
-     std::basic_string<TxByteType, TxByteTraits, TxAllocator>* data) {
-// change to const here and in requestbuffer
-           using response_t =
-        Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>;
-
-    auto request_callback = RequestBufferCallback<
-        BasicRequestBuffer<TxByteType, TxByteTraits, TxAllocator>>;
-    using string_t = std::basic_string<TxByteType, TxByteTraits, TxAllocator>;
-    using req_buff_t =
-        BasicRequestBuffer<TxByteType, TxByteTraits, TxAllocator>;
+       std::basic_string<TxByteType, TxByteTraits, TxAllocator>* data) {
+    return Post<RxByteType, RxByteTraits, RxAllocator>(url,
+                                                       RequestBody{*data});
+  }
 
-    req_buff_t bdata{data};
+  /**
+   * @brief Sends a POST request whose body is pushed to [stream] by another
+   * thread while it is being sent, returns once [stream] is closed and the
+   * response received
+   *
+   */
+  template <typename RxByteType = char,
+            typename RxByteTraits = std::char_traits<RxByteType>,
+            typename RxAllocator = std::allocator<RxByteType>>
 
-    StatusCode config_status = StatusCode::OK;
+  std::pair<
+      Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>,
+      StatusCode>
+  Post(std::string_view url, RequestStream* stream) {
+    using response_t =
+        Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>;
 
-    config_status = static_cast<StatusCode>(
+    StatusCode config_status = static_cast<StatusCode>(
         curl_easy_setopt(curl_handle_, CURLOPT_POST, 1L));
-
     if (!IsOK(config_status))
       return std::make_pair(response_t{}, config_status);
 
-    config_status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle_, CURLOPT_READFUNCTION, request_callback));
-
+    config_status = static_cast<StatusCode>(curl_easy_setopt(
+        curl_handle_, CURLOPT_READFUNCTION, RequestStream::ReadCallback));
     if (!IsOK(config_status))
       return std::make_pair(response_t{}, config_status);
 
     config_status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle_, CURLOPT_READDATA, &bdata));
-
+        curl_easy_setopt(curl_handle_, CURLOPT_READDATA, stream));
     if (!IsOK(config_status))
       return std::make_pair(response_t{}, config_status);
 
-    auto [resp, status] = Get<RxByteType, RxByteTraits, RxAllocator>(url);
+    request_stream_ = stream;
+    auto [resp, status] =
+        Fetch<RxByteType, RxByteTraits, RxAllocator>(url, false);
+    request_stream_ = nullptr;
 
     curl_easy_setopt(curl_handle_, CURLOPT_READDATA, nullptr);
     curl_easy_setopt(curl_handle_, CURLOPT_READFUNCTION, nullptr);
-    curl_easy_setopt(curl_handle_, CURLOPT_POST, 0L);
+    curl_easy_setopt(curl_handle_, CURLOPT_HTTPGET, true);
 
     return std::make_pair(std::move(resp), status);
   }
@@ -195,13 +466,14 @@ class Client {
    * @brief Sends a POST request of Content-Type: multipart/form-data
    *
    * [MultipartFormData] Type to use for multipart form data fields, including
-   * files
+   * files. Pointers to bytes, e.g. string literals, are request bodies
    *
    */
   template <typename MultipartFormDataT = MultipartFormData,
             typename RxByteType = char,
             typename RxByteTraits = std::char_traits<RxByteType>,
-            typename RxAllocator = std::allocator<RxByteType>>
+            typename RxAllocator = std::allocator<RxByteType>,
+            typename = std::enable_if_t<std::is_class_v<MultipartFormDataT>>>
 
   std::pair<
       Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>,
@@ -209,7 +481,8 @@ class Client {
 
   Post(std::string_view url, MultipartFormDataT* multip_data) {
     multip_data->ConfigHandle(curl_handle_);
-    auto [resp, status] = Get<RxByteType, RxByteTraits, RxAllocator>(url);
+    auto [resp, status] =
+        Fetch<RxByteType, RxByteTraits, RxAllocator>(url, false);
 
     curl_easy_setopt(curl_handle_, CURLOPT_HTTPGET, true);
 
@@ -231,6 +504,23 @@ class Client {
       Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>,
       StatusCode>
   Get(std::string_view url) {
+    return Fetch<RxByteType, RxByteTraits, RxAllocator>(url, true);
+  }
+
+ private:
+  /**
+   * @brief performs the request the handle is set up for and buffers the
+   * response body, the request of every other method is sent through here.
+   *
+   * [hedgeable] the request is a GET or HEAD the hedge policy may duplicate
+   */
+  template <typename RxByteType = char,
+            typename RxByteTraits = std::char_traits<RxByteType>,
+            typename RxAllocator = std::allocator<RxByteType>>
+  std::pair<
+      Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>,
+      StatusCode>
+  Fetch(std::string_view url, bool hedgeable) {
     // note get by default, must not be changed nor set to get, other requests
     // use this as a template and if request method is changed, it is explicitly
     // set back to HTTPGET
@@ -246,7 +536,9 @@ class Client {
 
     using response_t = Response<response_buff_t>;
 
-    auto config_status = configuration.ConfigHandle(curl_handle_);
+    auto config_status =
+        configuration.ConfigHandle(curl_handle_, &applied_configuration_);
+    if (IsOK(config_status)) shared_state_ = configuration.shared_state;
 
     if (config_status != StatusCode::OK) {
       return std::make_pair(response_t{}, config_status);
@@ -259,7 +551,7 @@ class Client {
 
     response_t response{};
 
-    response_buff_t resp_buff{};
+    response_buff_t resp_buff{configuration.response_buffer};
 
     ResponseHeaderBuffer header{};
 
@@ -272,24 +564,45 @@ class Client {
         curl_easy_setopt(curl_handle_, CURLOPT_WRITEDATA, &resp_buff));
     if (!IsOK(config_status)) return std::make_pair(response, config_status);
 
+    ResponseHeaderContext<response_buff_t> header_context{&header, &resp_buff};
+
     config_status = static_cast<StatusCode>(
         curl_easy_setopt(curl_handle_, CURLOPT_HEADERFUNCTION,
-                         ResponseBufferCallback<ResponseHeaderBuffer>));
+                         ResponseHeaderReserveCallback<response_buff_t>));
     if (!IsOK(config_status)) return std::make_pair(response, config_status);
 
     config_status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle_, CURLOPT_HEADERDATA, &header));
+        curl_easy_setopt(curl_handle_, CURLOPT_HEADERDATA, &header_context));
     if (!IsOK(config_status)) return std::make_pair(response, config_status);
 
-    StatusCode status = StatusCode::OK;
-    status = static_cast<StatusCode>(curl_easy_perform(curl_handle_));
+    TransferWatch watch{};
+    config_status =
+        configuration.Watch(curl_handle_, &watch, &applied_configuration_);
+    if (!IsOK(config_status)) return std::make_pair(response, config_status);
+
+    bool hedged = hedgeable && configuration.hedge_policy.enabled &&
+                  request_stream_ == nullptr;
+
+    StatusCode status = Perform(
+        url, &watch, &header, false,
+        [&] {
+          return hedged ? PerformHedged(url, &header_context, &watch)
+                        : Perform();
+        },
+        [&resp_buff] { resp_buff = response_buff_t{resp_buff.options()}; });
+    if (status == StatusCode::CircuitOpen)
+      return std::make_pair(std::move(response), status);
     // if (!IsOK(status)) return std::make_pair(response, status);
 
-    response.Prepare(curl_handle_, std::move(resp_buff), std::move(header));
+    response.Prepare(curl_handle_, std::move(resp_buff), std::move(header),
+                     configuration.response_fields);
+    response.throughput_ = watch.throughput();
 
     return std::make_pair(std::move(response), status);
   }
 
+ public:
+
   /**
    * @brief Performs a GET request and stores the response in [target]
    *
@@ -344,7 +657,7 @@ class Client {
     //
 
     auto [resp, status] =
-        Get<rx_byte_type, rx_byte_traits, rx_allocator_t>(url);
+        Fetch<rx_byte_type, rx_byte_traits, rx_allocator_t>(url, true);
 
     //
     //
@@ -366,24 +679,27 @@ class Client {
   }
 
   /**
-   * @brief Performs a GET request and downloads server response into a
-   * basic_ofstream parameter of the specified RxByteType
+   * @brief Performs a GET request and hands every fragment of the response
+   * body to [sink] as it is received, the body is never buffered.
    *
+   * [sink] callable, or object with a Write member, taking a
+   * std::basic_string_view of RxByteType and returning void, or false to
+   * abort the transfer. An optional Reserve(size) member is called with the
+   * Content-Length of the response.
    */
   template <typename RxByteType = char,
             typename RxByteTraits = std::char_traits<RxByteType>,
-            typename RxAllocator = std::allocator<RxByteType>>
-  // Download into output file
+            typename RxAllocator = std::allocator<RxByteType>,
+            typename Sink_t>
   std::pair<
       Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>,
       StatusCode>
-  Download(std::string_view url,
-           std::basic_ofstream<RxByteType, RxByteTraits>* file) {
+  Stream(std::string_view url, Sink_t&& sink) {
     using rx_byte_type = RxByteType;
 
     using rx_byte_traits = RxByteTraits;
 
-    using rx_file_t = std::basic_ofstream<RxByteType, RxByteTraits>;
+    using rx_sink_t = std::remove_reference_t<Sink_t>;
 
     using rx_allocator_t = RxAllocator;
     using response_buff_t =
@@ -391,7 +707,9 @@ class Client {
 
     using response_t = Response<response_buff_t>;
 
-    auto config_status = configuration.ConfigHandle(curl_handle_);
+    auto config_status =
+        configuration.ConfigHandle(curl_handle_, &applied_configuration_);
+    if (IsOK(config_status)) shared_state_ = configuration.shared_state;
     if (config_status != StatusCode::OK) {
       return std::make_pair(response_t{}, config_status);
     }
@@ -408,100 +726,105 @@ class Client {
     ResponseHeaderBuffer header{};
 
     config_status = static_cast<StatusCode>(curl_easy_setopt(
-        curl_handle_, CURLOPT_WRITEFUNCTION, ResponseFileCallback<rx_file_t>));
+        curl_handle_, CURLOPT_WRITEFUNCTION,
+        (ResponseSinkCallback<rx_sink_t, rx_byte_type, rx_byte_traits>)));
     if (!IsOK(config_status)) return std::make_pair(response, config_status);
 
     config_status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle_, CURLOPT_WRITEDATA, file));
+        curl_easy_setopt(curl_handle_, CURLOPT_WRITEDATA, &sink));
     if (!IsOK(config_status)) return std::make_pair(response, config_status);
 
+    ResponseHeaderContext<rx_sink_t> header_context{&header, &sink};
+
     config_status = static_cast<StatusCode>(
         curl_easy_setopt(curl_handle_, CURLOPT_HEADERFUNCTION,
-                         ResponseBufferCallback<ResponseHeaderBuffer>));
+                         ResponseHeaderReserveCallback<rx_sink_t>));
     if (!IsOK(config_status)) return std::make_pair(response, config_status);
 
     config_status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle_, CURLOPT_HEADERDATA, &header));
+        curl_easy_setopt(curl_handle_, CURLOPT_HEADERDATA, &header_context));
     if (!IsOK(config_status)) return std::make_pair(response, config_status);
 
-    StatusCode status = StatusCode::OK;
-    status = static_cast<StatusCode>(curl_easy_perform(curl_handle_));
+    TransferWatch watch{};
+    config_status =
+        configuration.Watch(curl_handle_, &watch, &applied_configuration_);
+    if (!IsOK(config_status)) return std::make_pair(response, config_status);
+
+    StatusCode status = Perform(url, &watch, &header, true,
+                                [this] { return Perform(); }, [] {});
+    if (status == StatusCode::CircuitOpen)
+      return std::make_pair(std::move(response), status);
     // if (!IsOK(status)) return std::make_pair(response, status);
 
-    response.Prepare(curl_handle_, std::move(resp_buff), std::move(header));
+    response.Prepare(curl_handle_, std::move(resp_buff), std::move(header),
+                     configuration.response_fields);
+    response.throughput_ = watch.throughput();
 
     return std::make_pair(std::move(response), status);
   }
 
   /**
-   * @brief Performs a GET Request and stores response in memory (Specified
-   * string buffer)
-   *
+   * @brief Performs a GET request and downloads server response into a
+   * basic_ofstream parameter of the specified RxByteType
    *
    */
-
   template <typename RxByteType = char,
             typename RxByteTraits = std::char_traits<RxByteType>,
             typename RxAllocator = std::allocator<RxByteType>>
-
+  // Download into output file
   std::pair<
       Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>,
       StatusCode>
   Download(std::string_view url,
-           std::basic_string<RxByteType, RxByteTraits, RxAllocator>* target) {
-    using rx_byte_type = RxByteType;
-
-    using rx_byte_traits = RxByteTraits;
-
-    using rx_str_t = std::basic_string<RxByteType, RxByteTraits, RxAllocator>;
-
-    using rx_allocator_t = RxAllocator;
-    using response_buff_t =
-        BasicResponseBuffer<rx_byte_type, rx_byte_traits, rx_allocator_t>;
-
-    using response_t = Response<response_buff_t>;
-
-    auto config_status = configuration.ConfigHandle(curl_handle_);
-    if (config_status != StatusCode::OK) {
-      return std::make_pair(response_t{}, config_status);
-    }
-
-    config_status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle_, CURLOPT_URL, url.data()));
-    if (!IsOK(config_status))
-      return std::make_pair(response_t{}, config_status);
-
-    response_t response{};
+           std::basic_ofstream<RxByteType, RxByteTraits>* file) {
+    using rx_file_t = std::basic_ofstream<RxByteType, RxByteTraits>;
 
-    response_buff_t resp_buff{};
+    return Stream<RxByteType, RxByteTraits, RxAllocator>(
+        url, FileSink<rx_file_t>{file});
+  }
 
-    ResponseHeaderBuffer header{};
+#if defined(SWISH_HAS_FILE_SINK)
+  /**
+   * @brief Performs a GET request and downloads server response into [file],
+   * preallocated from the response's Content-Length, and flushes it to disk
+   * once the transfer succeeded
+   *
+   */
+  std::pair<Response<BasicResponseBuffer<char>>, StatusCode> Download(
+      std::string_view url, PreallocatedFileSink* file) {
+    if (!file->is_open())
+      return std::make_pair(Response<BasicResponseBuffer<char>>{},
+                            StatusCode::WriteCallbackError);
 
-    config_status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle_, CURLOPT_WRITEFUNCTION,
-                         ResponseBodyStringCallback<rx_str_t>));
-    if (!IsOK(config_status)) return std::make_pair(response, config_status);
+    auto [resp, status] = Stream(url, *file);
 
-    config_status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle_, CURLOPT_WRITEDATA, target));
-    if (!IsOK(config_status)) return std::make_pair(response, config_status);
+    if (IsOK(status) && !file->Commit())
+      status = StatusCode::WriteCallbackError;
 
-    config_status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle_, CURLOPT_HEADERFUNCTION,
-                         ResponseBufferCallback<ResponseHeaderBuffer>));
-    if (!IsOK(config_status)) return std::make_pair(response, config_status);
+    return std::make_pair(std::move(resp), status);
+  }
+#endif
 
-    config_status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle_, CURLOPT_HEADERDATA, &header));
-    if (!IsOK(config_status)) return std::make_pair(response, config_status);
+  /**
+   * @brief Performs a GET Request and stores response in memory (Specified
+   * string buffer)
+   *
+   *
+   */
 
-    StatusCode status = StatusCode::OK;
-    status = static_cast<StatusCode>(curl_easy_perform(curl_handle_));
-    // if (!IsOK(status)) return std::make_pair(response, status);
+  template <typename RxByteType = char,
+            typename RxByteTraits = std::char_traits<RxByteType>,
+            typename RxAllocator = std::allocator<RxByteType>>
 
-    response.Prepare(curl_handle_, std::move(resp_buff), std::move(header));
+  std::pair<
+      Response<BasicResponseBuffer<RxByteType, RxByteTraits, RxAllocator>>,
+      StatusCode>
+  Download(std::string_view url,
+           std::basic_string<RxByteType, RxByteTraits, RxAllocator>* target) {
+    using rx_str_t = std::basic_string<RxByteType, RxByteTraits, RxAllocator>;
 
-    return std::make_pair(std::move(response), status);
+    return Stream<RxByteType, RxByteTraits, RxAllocator>(
+        url, StringSink<rx_str_t>{target});
   }
 
   /**
@@ -518,7 +841,7 @@ class Client {
   Delete(std::string_view url) {
     curl_easy_setopt(curl_handle_, CURLOPT_CUSTOMREQUEST, "DELETE");
 
-    auto [resp, status] = Get(url);
+    auto [resp, status] = Fetch(url, false);
 
     curl_easy_setopt(curl_handle_, CURLOPT_CUSTOMREQUEST, nullptr);
 
@@ -533,7 +856,7 @@ class Client {
   auto Ping(std::string_view url) -> decltype(Get("url")) {
     curl_easy_setopt(curl_handle_, CURLOPT_CONNECT_ONLY, true);
 
-    auto [resp, status] = Get(url);
+    auto [resp, status] = Fetch(url, false);
 
     curl_easy_setopt(curl_handle_, CURLOPT_CONNECT_ONLY, false);
     return std::make_pair(std::move(resp), status);
@@ -554,7 +877,8 @@ class Client {
     curl_easy_setopt(curl_handle_, CURLOPT_CUSTOMREQUEST, "TRACE");
     curl_easy_setopt(curl_handle_, CURLOPT_NOBODY, true);
 
-    auto [resp, status] = Get<RxByteType, RxByteTraits, RxAllocator>(url);
+    auto [resp, status] =
+        Fetch<RxByteType, RxByteTraits, RxAllocator>(url, false);
 
     curl_easy_setopt(curl_handle_, CURLOPT_NOBODY, false);
     curl_easy_setopt(curl_handle_, CURLOPT_CUSTOMREQUEST, nullptr);
@@ -577,7 +901,8 @@ class Client {
   Options(std::string_view url) {
     curl_easy_setopt(curl_handle_, CURLOPT_CUSTOMREQUEST, "OPTIONS");
 
-    auto [resp, status] = Get<RxByteType, RxByteTraits, RxAllocator>(url);
+    auto [resp, status] =
+        Fetch<RxByteType, RxByteTraits, RxAllocator>(url, false);
 
     curl_easy_setopt(curl_handle_, CURLOPT_CUSTOMREQUEST, nullptr);
 
@@ -595,17 +920,28 @@ class Client {
   Client(Client&& to_move) {
     curl_handle_ = to_move.curl_handle_;
     to_move.curl_handle_ = nullptr;
+    hedge_multi_ = std::exchange(to_move.hedge_multi_, nullptr);
+    hedge_delays_ = std::move(to_move.hedge_delays_);
+    shared_state_ = std::move(to_move.shared_state_);
     configuration = std::move(to_move.configuration);
   }
 
+  // [to_move] takes the handle this client had, with the share it is attached
+  // to, and cleans it up
   Client& operator=(Client&& to_move) {
-    curl_handle_ = to_move.curl_handle_;
-    to_move.curl_handle_ = nullptr;
+    std::swap(curl_handle_, to_move.curl_handle_);
+    std::swap(applied_configuration_, to_move.applied_configuration_);
+    std::swap(shared_state_, to_move.shared_state_);
+    std::swap(hedge_multi_, to_move.hedge_multi_);
+    std::swap(hedge_delays_, to_move.hedge_delays_);
     configuration = std::move(to_move.configuration);
     return *this;
   }
 
-  ~Client() noexcept { curl_easy_cleanup(curl_handle_); };
+  ~Client() noexcept {
+    curl_easy_cleanup(curl_handle_);
+    if (hedge_multi_ != nullptr) curl_multi_cleanup(hedge_multi_);
+  };
 };
 };  // namespace swish
 #endif
\ No newline at end of file
@@ -0,0 +1,215 @@
+#ifndef ______lib_SWISH___client_pool_h
+#define ______lib_SWISH___client_pool_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <cstddef>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "client.h"
+
+namespace swish {
+
+/**
+ * @brief Thread-safe pool of reusable Clients.
+ *
+ * A returned Client keeps its easy handle and with it the connection, DNS and
+ * TLS session caches, so the next lease of it to the same host skips the
+ * handshake. Idle clients are kept in per-thread shards, a thread checks out
+ * from and returns to its own shard and only touches the others when its own
+ * is empty, so workers rarely contend on the same lock and tend to get back
+ * the client that already holds connections to their hosts.
+ *
+ * Clients created by the pool are given a copy of [configuration], and are
+ * given it again when returned, so headers or credentials set by one lessee
+ * do not carry over to the next. It must not be modified while other threads
+ * are leasing from the pool.
+ */
+class ClientPool {
+  struct alignas(64) Shard {
+    std::mutex mutex{};
+    std::vector<std::unique_ptr<Client>> idle{};
+  };
+
+  size_t shard_count_ = 1;
+  size_t max_idle_per_shard_ = 0;
+  std::unique_ptr<Shard[]> shards_{nullptr};
+
+  Shard& HomeShard() {
+    return shards_[std::hash<std::thread::id>{}(std::this_thread::get_id()) %
+                   shard_count_];
+  }
+
+  std::unique_ptr<Client> CheckOut() {
+    Shard& home = HomeShard();
+
+    {
+      std::lock_guard<std::mutex> lock{home.mutex};
+      if (!home.idle.empty()) {
+        auto client = std::move(home.idle.back());
+        home.idle.pop_back();
+        return client;
+      }
+    }
+
+    // steal from any shard that is not busy
+    for (size_t i = 0; i < shard_count_; i++) {
+      Shard& shard = shards_[i];
+      if (&shard == &home) continue;
+
+      std::unique_lock<std::mutex> lock{shard.mutex, std::try_to_lock};
+      if (!lock.owns_lock() || shard.idle.empty()) continue;
+
+      auto client = std::move(shard.idle.back());
+      shard.idle.pop_back();
+      return client;
+    }
+
+    auto client = std::make_unique<Client>();
+    client->configuration = configuration;
+    return client;
+  }
+
+  void Return(std::unique_ptr<Client> client) {
+    // options the lessee changed are undone, the next request pushes those
+    // that differ from the ones last applied to the handle
+    client->configuration = configuration;
+
+    Shard& home = HomeShard();
+
+    std::lock_guard<std::mutex> lock{home.mutex};
+    // an overflowing client is destroyed, closing its connections
+    if (home.idle.size() < max_idle_per_shard_)
+      home.idle.push_back(std::move(client));
+  }
+
+ public:
+  /**
+   * @brief RAII handle to a leased Client, returns it to the pool on
+   * destruction
+   *
+   */
+  class Lease {
+    ClientPool* pool_ = nullptr;
+    std::unique_ptr<Client> client_{nullptr};
+
+    Lease(ClientPool* pool, std::unique_ptr<Client> client)
+        : pool_{pool}, client_{std::move(client)} {}
+
+    friend class ClientPool;
+
+   public:
+    Lease(const Lease&) = delete;
+
+    Lease& operator=(const Lease&) = delete;
+
+    Lease(Lease&& to_move)
+        : pool_{to_move.pool_}, client_{std::move(to_move.client_)} {}
+
+    Lease& operator=(Lease&& to_move) {
+      if (this == &to_move) return *this;
+      if (client_ != nullptr) pool_->Return(std::move(client_));
+      pool_ = to_move.pool_;
+      client_ = std::move(to_move.client_);
+      return *this;
+    }
+
+    Client* operator->() { return client_.get(); }
+
+    Client& operator*() { return *client_; }
+
+    Client* get() { return client_.get(); }
+
+    ~Lease() noexcept {
+      if (client_ != nullptr) pool_->Return(std::move(client_));
+    }
+  };
+
+  Configuration configuration{};
+
+  /**
+   * @brief [shard_count] number of independently locked idle lists, defaults to
+   * the number of hardware threads. [max_idle_per_shard] clients kept per
+   * shard, clients returned past this are destroyed.
+   */
+  explicit ClientPool(size_t shard_count = std::thread::hardware_concurrency(),
+                      size_t max_idle_per_shard = 16)
+      : shard_count_{shard_count == 0 ? 1 : shard_count},
+        max_idle_per_shard_{max_idle_per_shard},
+        shards_{std::make_unique<Shard[]>(shard_count_)} {}
+
+  /**
+   * @brief Leases an idle Client, creating one if none is available
+   *
+   */
+  Lease Acquire() { return Lease{this, CheckOut()}; }
+
+  /**
+   * @brief Creates up to [count] Clients ahead of time into the calling
+   * thread's shard
+   *
+   */
+  void Reserve(size_t count) {
+    Shard& home = HomeShard();
+
+    std::lock_guard<std::mutex> lock{home.mutex};
+    while (home.idle.size() < count && home.idle.size() < max_idle_per_shard_) {
+      auto client = std::make_unique<Client>();
+      client->configuration = configuration;
+      home.idle.push_back(std::move(client));
+    }
+  }
+
+  // number of idle clients across all shards
+  size_t idle() {
+    size_t count = 0;
+    for (size_t i = 0; i < shard_count_; i++) {
+      std::lock_guard<std::mutex> lock{shards_[i].mutex};
+      count += shards_[i].idle.size();
+    }
+    return count;
+  }
+
+  ClientPool(const ClientPool&) = delete;
+
+  ClientPool& operator=(const ClientPool&) = delete;
+
+  ClientPool(ClientPool&&) = delete;
+
+  ClientPool& operator=(ClientPool&&) = delete;
+
+  // every Lease must be released before the pool is destroyed
+  ~ClientPool() = default;
+};
+
+};  // namespace swish
+
+#endif
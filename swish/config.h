@@ -27,15 +27,27 @@
 
 
 #include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <tuple>
 
 #include "auth.h"
+#include "bandwidth.h"
+#include "circuit_breaker.h"
 #include "cookie.h"
+#include "hedge.h"
 #include "default_callbacks.h"
 #include "http.h"
+#include "metrics.h"
+#include "progress.h"
 #include "proxy.h"
 #include "request.h"
+#include "response.h"
+#include "retry.h"
+#include "shared_state.h"
 #include "status_codes.h"
+#include "transfer_watch.h"
 #include "type_helpers.h"
 #include "utils.h"
 
@@ -57,93 +69,221 @@ if(curl) {
 
 namespace swish {
 
-// data structure to represent request configurations for the client
-struct Configuration {
-  // performs all effects on curl
+/**
+ * @brief options a Configuration last pushed to a handle, so that the next
+ * request only pushes those changed since. Valid for as long as the handle is
+ * not reset or given these options by other means.
+ */
+struct AppliedConfiguration {
+  bool valid = false;
 
-  StatusCode ConfigHandle(CURL* curl_handle) {
-    default_monitor_ = {0, 0, 0, 0};
-    StatusCode status = StatusCode::OK;
+  http::version http_version{};
+  bool progress_enabled = false;
+  curl_xferinfo_callback progress_function = nullptr;
+  const void* progress_data = nullptr;
+  bool follow_redirection = false;
+  bool verbose = false;
+  int64_t maximum_redirects = 0;
+  bool forward_authorization_headers = false;
+  std::string user_agent{};
+  std::chrono::milliseconds timeout{0};
+  uint64_t resume_from = 0;
+  std::string cookie_file_storage{};
+  const curl_slist* header = nullptr;
 
-    status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle, CURLOPT_HTTP_VERSION, http_version));
-    if (!IsOK(status)) return status;
+  Credentials authentication_credentials{};
 
-    status = static_cast<StatusCode>(curl_easy_setopt(
-        curl_handle, CURLOPT_NOPROGRESS, !use_progress_callback));
-    if (!IsOK(status)) return status;
+  ProxyProtocol proxy_protocol{};
+  std::string proxy_host{};
+  ProxyCredentials proxy_credentials{};
+  const curl_slist* proxy_header = nullptr;
 
-    status = static_cast<StatusCode>(curl_easy_setopt(
-        curl_handle, CURLOPT_XFERINFOFUNCTION, progress_callback));
-    if (!IsOK(status)) return status;
+  Cookie session_cookie{};
 
-    status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle, CURLOPT_XFERINFODATA, &default_monitor_));
-    if (!IsOK(status)) return status;
+  const CURLSH* share = nullptr;
+};
 
-    status = static_cast<StatusCode>(curl_easy_setopt(
-        curl_handle, CURLOPT_FOLLOWLOCATION, follow_redirection));
-    if (!IsOK(status)) return status;
+// data structure to represent request configurations for the client
+struct Configuration {
+  /**
+   * @brief performs all effects on curl. Given the options last applied to
+   * [curl_handle], only pushes those that changed and records them.
+   *
+   */
+  StatusCode ConfigHandle(CURL* curl_handle,
+                          AppliedConfiguration* applied = nullptr) {
+    default_monitor_ = {0, 0, 0, 0};
+    StatusCode status = StatusCode::OK;
 
-    status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, verbose));
-    if (!IsOK(status)) return status;
+    // every option is pushed without a valid record of the applied ones
+    bool all = applied == nullptr || !applied->valid;
+    // the record is only valid again once every option was pushed
+    bool record = applied != nullptr;
+    if (record) applied->valid = false;
 
-    status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle, CURLOPT_MAXREDIRS, maximum_redirects));
-    if (!IsOK(status)) return status;
+    if (all || applied->http_version != http_version) {
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(curl_handle, CURLOPT_HTTP_VERSION, http_version));
+      if (!IsOK(status)) return status;
+      if (record) applied->http_version = http_version;
+    }
 
-    status = static_cast<StatusCode>(curl_easy_setopt(
-        curl_handle, CURLOPT_UNRESTRICTED_AUTH, forward_authorization_headers));
+    auto [progress_enabled, progress_function, progress_data] =
+        TransferInfo();
+    status = ConfigTransferInfo(curl_handle, applied, all, progress_enabled,
+                                progress_function, progress_data);
     if (!IsOK(status)) return status;
 
-    if (user_agent.empty()) {
+    if (all || applied->follow_redirection != follow_redirection) {
+      status = static_cast<StatusCode>(curl_easy_setopt(
+          curl_handle, CURLOPT_FOLLOWLOCATION, follow_redirection));
+      if (!IsOK(status)) return status;
+      if (record) applied->follow_redirection = follow_redirection;
+    }
+
+    if (all || applied->verbose != verbose) {
       status = static_cast<StatusCode>(
-          curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, nullptr));
-    } else {
+          curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, verbose));
+      if (!IsOK(status)) return status;
+      if (record) applied->verbose = verbose;
+    }
+
+    if (all || applied->maximum_redirects != maximum_redirects) {
       status = static_cast<StatusCode>(
-          curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, user_agent.c_str()));
+          curl_easy_setopt(curl_handle, CURLOPT_MAXREDIRS, maximum_redirects));
+      if (!IsOK(status)) return status;
+      if (record) applied->maximum_redirects = maximum_redirects;
     }
-    if (!IsOK(status)) return status;
 
-    status = static_cast<StatusCode>(
-        curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, timeout.count()));
-    if (!IsOK(status)) return status;
+    if (all || applied->forward_authorization_headers !=
+                   forward_authorization_headers) {
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(curl_handle, CURLOPT_UNRESTRICTED_AUTH,
+                           forward_authorization_headers));
+      if (!IsOK(status)) return status;
+      if (record)
+        applied->forward_authorization_headers = forward_authorization_headers;
+    }
 
-    if (cookie_file_storage.empty()) {
+    if (all || applied->user_agent != user_agent) {
+      if (user_agent.empty()) {
+        status = static_cast<StatusCode>(
+            curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, nullptr));
+      } else {
+        status = static_cast<StatusCode>(curl_easy_setopt(
+            curl_handle, CURLOPT_USERAGENT, user_agent.c_str()));
+      }
+      if (!IsOK(status)) return status;
+      if (record) applied->user_agent = user_agent;
+    }
+
+    if (all || applied->timeout != timeout) {
       status = static_cast<StatusCode>(
-          curl_easy_setopt(curl_handle, CURLOPT_COOKIEJAR, nullptr));
+          curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, timeout.count()));
+      if (!IsOK(status)) return status;
+      if (record) applied->timeout = timeout;
+    }
 
-    } else {
+    if (all || applied->resume_from != resume_from) {
       status = static_cast<StatusCode>(curl_easy_setopt(
-          curl_handle, CURLOPT_COOKIEJAR, cookie_file_storage.c_str()));
-    };
-    if (!IsOK(status)) return status;
+          curl_handle, CURLOPT_RESUME_FROM_LARGE,
+          static_cast<curl_off_t>(resume_from)));
+      if (!IsOK(status)) return status;
+      if (record) applied->resume_from = resume_from;
+    }
 
-    //
-    //
-    //
-    // prep
-    // pointer to nullptr if not set
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER,
-                     header.header_data_.get());
-    //
-    //
-    //
-
-    status = static_cast<StatusCode>(
-        authentication_credentials.ConfigHandle(curl_handle));
-    if (!IsOK(status)) return status;
+    if (all || applied->cookie_file_storage != cookie_file_storage) {
+      if (cookie_file_storage.empty()) {
+        status = static_cast<StatusCode>(
+            curl_easy_setopt(curl_handle, CURLOPT_COOKIEJAR, nullptr));
+
+      } else {
+        status = static_cast<StatusCode>(curl_easy_setopt(
+            curl_handle, CURLOPT_COOKIEJAR, cookie_file_storage.c_str()));
+      };
+      if (!IsOK(status)) return status;
+      if (record) applied->cookie_file_storage = cookie_file_storage;
+    }
 
-    status = static_cast<StatusCode>(proxy.ConfigHandle(curl_handle));
-    if (!IsOK(status)) return status;
+    // the list is rebuilt elsewhere whenever the fields change
+    curl_slist* header_list = header.slist();
+    if (all || applied->header != header_list) {
+      // pointer to nullptr if not set
+      curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, header_list);
+      if (record) applied->header = header_list;
+    }
 
-    status = session_cookie.ConfigHandle(curl_handle);
-    if (!IsOK(status)) return status;
+    if (all ||
+        applied->authentication_credentials != authentication_credentials) {
+      status = static_cast<StatusCode>(
+          authentication_credentials.ConfigHandle(curl_handle));
+      if (!IsOK(status)) return status;
+      if (record)
+        applied->authentication_credentials = authentication_credentials;
+    }
+
+    curl_slist* proxy_header_list = proxy.header.slist();
+    if (all || applied->proxy_protocol != proxy.protocol ||
+        applied->proxy_host != proxy.host ||
+        applied->proxy_credentials != proxy.credentials ||
+        applied->proxy_header != proxy_header_list) {
+      status = static_cast<StatusCode>(proxy.ConfigHandle(curl_handle));
+      if (!IsOK(status)) return status;
+      if (record) {
+        applied->proxy_protocol = proxy.protocol;
+        applied->proxy_host = proxy.host;
+        applied->proxy_credentials = proxy.credentials;
+        applied->proxy_header = proxy_header_list;
+      }
+    }
+
+    if (all || applied->session_cookie != session_cookie) {
+      status = session_cookie.ConfigHandle(curl_handle);
+      if (!IsOK(status)) return status;
+      if (record) applied->session_cookie = session_cookie;
+    }
+
+    CURLSH* share =
+        shared_state == nullptr ? nullptr : shared_state->share_handle();
+    if (all || applied->share != share) {
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(curl_handle, CURLOPT_SHARE, share));
+      if (!IsOK(status)) return status;
+      if (record) applied->share = share;
+    }
 
+    if (record) applied->valid = true;
     return StatusCode::OK;
   };
 
+  /**
+   * @brief puts [watch] in front of the progress reporting of the next
+   * transfer of [curl_handle] if the stall policy, throughput tracking or
+   * bandwidth governor need it. Either way [watch] finishes the progress slot
+   * along with the transfer. Called once the handle is configured.
+   *
+   */
+  StatusCode Watch(CURL* curl_handle, TransferWatch* watch,
+                   AppliedConfiguration* applied = nullptr) {
+    if (!TransferWatch::Needed(stall_policy, track_throughput,
+                               bandwidth_governor != nullptr)) {
+      watch->Report(progress_slot);
+      return StatusCode::OK;
+    }
+
+    auto [progress_enabled, progress_function, progress_data] =
+        TransferInfo();
+    watch->Start(curl_handle, stall_policy,
+                 BandwidthShare{bandwidth_governor, traffic_class},
+                 progress_enabled ? progress_function : nullptr,
+                 const_cast<void*>(progress_data));
+    watch->Report(progress_slot);
+
+    return ConfigTransferInfo(curl_handle, applied,
+                              applied == nullptr || !applied->valid, true,
+                              TransferWatch::Callback, watch);
+  }
+
   // version
   http::version http_version = http::Version_2_TLS;
 
@@ -152,6 +292,35 @@ struct Configuration {
 
   bool use_progress_callback = false;
 
+  // slot of a ProgressRenderer the progress of requests is stored into, in
+  // place of calling [progress_callback]
+  ProgressSlot* progress_slot = nullptr;
+
+  // smooths the transfer rates of requests into Response::throughput()
+  bool track_throughput = false;
+
+  // aborts downloads far slower than their host's recent ones, their
+  // throughput is tracked
+  StallPolicy stall_policy{};
+
+  // shapes the traffic of requests together with every other request
+  // attached to it, e.g. &BandwidthGovernor::Global(). Unlimited if null
+  BandwidthGovernor* bandwidth_governor = nullptr;
+
+  // priority of the requests' traffic under [bandwidth_governor]
+  TrafficClass traffic_class = TrafficClass::Interactive;
+
+  // failed requests of every client are attempted again on the same handle
+  // if enabled
+  RetryPolicy retry_policy{};
+
+  // slow GET and HEAD requests of a Client are duplicated if enabled
+  HedgePolicy hedge_policy{};
+
+  // requests to a host that keeps failing fail fast with
+  // StatusCode::CircuitOpen if enabled
+  CircuitBreakerPolicy circuit_breaker{};
+
   // example.com is redirected, so we tell libcurl to follow redirection
   bool follow_redirection = false;
 
@@ -171,6 +340,9 @@ struct Configuration {
   // known by checking against status code
   std::chrono::milliseconds timeout{0};
 
+  // byte offset to continue a download from, requested as a range
+  uint64_t resume_from = 0;
+
   // file to export cookies to
   std::string cookie_file_storage{};
 
@@ -187,6 +359,20 @@ struct Configuration {
   // request headers
   RequestHeader header{};
 
+  // storage of received response bodies
+  ResponseBufferOptions response_buffer{};
+
+  // caches shared with other clients, none if not set
+  std::shared_ptr<SharedState> shared_state{};
+
+  // metadata read into responses, a combination of ResponseField flags.
+  // Leaving out what is not needed saves a curl_easy_getinfo call each.
+  uint32_t response_fields = kAllResponseFields;
+
+  // registry every transfer is recorded in, e.g. &Metrics::Global(). Off by
+  // default, recording reads about 8 fields of every finished transfer
+  Metrics* metrics = nullptr;
+
   // TODO(lamarrr): add forward_post on redirect
   // example.com is redirected, so we tell libcurl to send POST on 301, 302
   // and 303 HTTP response codes
@@ -196,6 +382,48 @@ struct Configuration {
 
  private:
   TransferSpeedMonitor<int64_t, double> default_monitor_{0, 0, 0, 0};
+
+  // transfer info callback and data the configuration reports progress to,
+  // and whether progress is reported at all
+  std::tuple<bool, curl_xferinfo_callback, const void*> TransferInfo() const {
+    if (progress_slot != nullptr)
+      return {true, ProgressSlot::Callback, progress_slot};
+
+    return {use_progress_callback,
+            reinterpret_cast<curl_xferinfo_callback>(progress_callback),
+            &default_monitor_};
+  }
+
+  StatusCode ConfigTransferInfo(CURL* curl_handle,
+                                AppliedConfiguration* applied, bool all,
+                                bool enabled, curl_xferinfo_callback function,
+                                const void* data) {
+    StatusCode status = StatusCode::OK;
+    bool record = applied != nullptr;
+
+    if (all || applied->progress_enabled != enabled) {
+      status = static_cast<StatusCode>(curl_easy_setopt(
+          curl_handle, CURLOPT_NOPROGRESS, enabled ? 0L : 1L));
+      if (!IsOK(status)) return status;
+      if (record) applied->progress_enabled = enabled;
+    }
+
+    if (all || applied->progress_function != function) {
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(curl_handle, CURLOPT_XFERINFOFUNCTION, function));
+      if (!IsOK(status)) return status;
+      if (record) applied->progress_function = function;
+    }
+
+    if (all || applied->progress_data != data) {
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(curl_handle, CURLOPT_XFERINFODATA, data));
+      if (!IsOK(status)) return status;
+      if (record) applied->progress_data = data;
+    }
+
+    return status;
+  }
 };
 };  // namespace swish
 
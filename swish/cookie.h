@@ -53,7 +53,7 @@ class BasicMemoryCookie : public BasicCookie<ByteT, ByteTraits, Allocator> {
   using byte_type = ByteT;
   using allocator_type = std::allocator<byte_type>;
   using byte_traits = ByteTraits;
-  using size_type = typename allocator_type::size_type;
+  using size_type = typename std::allocator_traits<allocator_type>::size_type;
 
  public:
   BasicMemoryCookie(std::basic_string_view<byte_type, byte_traits> cookie_data)
@@ -75,7 +75,7 @@ class BasicFileCookie : public BasicCookie<ByteT, ByteTraits, Allocator> {
   using byte_type = ByteT;
   using allocator_type = std::allocator<byte_type>;
   using byte_traits = ByteTraits;
-  using size_type = typename allocator_type::size_type;
+  using size_type = typename std::allocator_traits<allocator_type>::size_type;
 
  public:
   BasicFileCookie(std::string_view cookie_data)
@@ -98,7 +98,7 @@ class BasicCookie {
   using byte_type = ByteT;
   using allocator_type = Allocator;
   using byte_traits = ByteTraits;
-  using size_type = typename allocator_type::size_type;
+  using size_type = typename std::allocator_traits<allocator_type>::size_type;
 
  private:
   CookieLocation location_ = CookieLocation::None;
@@ -123,6 +123,12 @@ class BasicCookie {
 
   BasicCookie& operator=(BasicCookie&& to_move) = default;
 
+  bool operator==(const BasicCookie& other) const {
+    return location_ == other.location_ && cookie_data_ == other.cookie_data_;
+  }
+
+  bool operator!=(const BasicCookie& other) const { return !(*this == other); }
+
   inline const bool& Empty() const { return cookie_data_.empty(); }
 
   inline const size_type size() const { return cookie_data_.size(); }
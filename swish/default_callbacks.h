@@ -25,10 +25,18 @@
  * 
  */
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 #include "io_buffers.h"
+#include "response_header.h"
 #include "utils.h"
 #include "xcurses.h"
 
@@ -57,7 +65,137 @@ size_type<ResponseBodyBuffer_t> ResponseBufferCallback(
     ResponseBodyBuffer_t* compactment) {
   size_type<ResponseBodyBuffer_t> total_size = total_count * byte_size;
 
-  compactment->PushCopy(contents, total_size);
+  // exceptions must not unwind through libcurl, aborting the transfer instead
+  try {
+    compactment->PushCopy(contents, total_size);
+  } catch (...) {
+    return 0;
+  }
+  return total_size;
+}
+
+// compares header field names case-insensitively
+inline bool HeaderNameEqual(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) return false;
+
+  for (size_t i = 0; i < a.size(); i++) {
+    if (std::tolower(static_cast<unsigned char>(a[i])) !=
+        std::tolower(static_cast<unsigned char>(b[i])))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief finds the value of header [line] if it is a [name] field, compared
+ * case-insensitively, with surrounding whitespace and line break trimmed
+ *
+ */
+inline bool HeaderFieldValue(std::string_view line, std::string_view name,
+                             std::string_view* value) {
+  if (line.size() <= name.size() || line[name.size()] != ':') return false;
+  if (!HeaderNameEqual(line.substr(0, name.size()), name)) return false;
+
+  line.remove_prefix(name.size() + 1);
+  while (!line.empty() && (line.front() == ' ' || line.front() == '\t'))
+    line.remove_prefix(1);
+  while (!line.empty() && (line.back() == '\r' || line.back() == '\n' ||
+                           line.back() == ' ' || line.back() == '\t'))
+    line.remove_suffix(1);
+
+  *value = line;
+  return true;
+}
+
+// parses a Content-Length value, -1 if it is not a length
+inline int64_t ParseContentLengthValue(std::string_view value) {
+  int64_t length = -1;
+  if (std::from_chars(value.data(), value.data() + value.size(), length).ec !=
+      std::errc{})
+    return -1;
+
+  return length;
+}
+
+// parses the value of a Content-Length header line, -1 if [line] is not one
+inline int64_t ParseContentLength(std::string_view line) {
+  std::string_view value{};
+  if (!HeaderFieldValue(line, "Content-Length", &value)) return -1;
+
+  return ParseContentLengthValue(value);
+}
+
+template <typename T, typename = void>
+struct is_reservable : std::false_type {};
+
+template <typename T>
+struct is_reservable<
+    T, std::void_t<decltype(std::declval<T&>().Reserve(size_t{}))>>
+    : std::true_type {};
+
+// response buffers and sinks opt in by providing Reserve(size)
+template <typename ResponseBody_t>
+inline void ReserveResponseBody(ResponseBody_t* body, size_t total_bytes) {
+  if constexpr (is_reservable<ResponseBody_t>::value)
+    body->Reserve(total_bytes);
+}
+
+template <typename ByteType, typename ByteTraits, typename Allocator>
+inline void ReserveResponseBody(
+    std::basic_string<ByteType, ByteTraits, Allocator>* body,
+    size_t total_bytes) {
+  body->reserve(body->size() + std::min(total_bytes, max_body_reservation));
+}
+
+template <typename T, typename = void>
+struct accepts_header_lines : std::false_type {};
+
+template <typename T>
+struct accepts_header_lines<
+    T, std::void_t<decltype(std::declval<T&>().Header(std::string_view{}))>>
+    : std::true_type {};
+
+// header callback data of transfers reserving their body up front
+template <typename ResponseBody_t>
+struct ResponseHeaderContext {
+  ResponseHeaderBuffer* header = nullptr;
+  ResponseBody_t* body = nullptr;
+};
+
+/**
+ * @brief stores header lines like ResponseBufferCallback and reserves the
+ * response body once its Content-Length is received. Sinks with a
+ * Header(std::string_view) member also get every header line.
+ *
+ */
+template <typename ResponseBody_t>
+size_t ResponseHeaderReserveCallback(
+    char* contents, size_t byte_size, size_t total_count,
+    ResponseHeaderContext<ResponseBody_t>* context) {
+  size_t total_size = total_count * byte_size;
+
+  ResponseHeader::Field field{};
+
+  // exceptions must not unwind through libcurl, aborting the transfer instead
+  try {
+    field = context->header->Push({contents, total_size});
+
+    if constexpr (accepts_header_lines<ResponseBody_t>::value)
+      context->body->Header({contents, total_size});
+  } catch (...) {
+    return 0;
+  }
+
+  if (HeaderNameEqual(field.name, "Content-Length")) {
+    int64_t length = ParseContentLengthValue(field.value);
+    // the reservation is only a hint, a failed one leaves the body to grow as
+    // it is received
+    try {
+      if (length > 0) ReserveResponseBody(context->body, length);
+    } catch (...) {
+    }
+  }
+
   return total_size;
 }
 
@@ -71,6 +209,76 @@ size_type<RequestBodyBuffer_t> RequestBufferCallback(
   return source->Write(destination, total_size);
 }
 
+/**
+ * @brief hands every fragment of the response body to [sink] as it is
+ * received, without copying it.
+ *
+ * [sink] is either callable with, or has a Write member taking, a
+ * std::basic_string_view of ByteType. It may return void, or false to abort
+ * the transfer.
+ */
+template <typename Sink_t, typename ByteType = char,
+          typename ByteTraits = std::char_traits<ByteType>>
+size_t ResponseSinkCallback(ByteType* contents, size_t byte_size,
+                            size_t total_count, Sink_t* sink) {
+  using view_type = std::basic_string_view<ByteType, ByteTraits>;
+
+  size_t total_size = total_count * byte_size;
+  view_type fragment{contents, total_size};
+
+  // exceptions must not unwind through libcurl, aborting the transfer instead
+  try {
+    if constexpr (std::is_invocable_v<Sink_t&, view_type>) {
+      if constexpr (std::is_same_v<std::invoke_result_t<Sink_t&, view_type>,
+                                   bool>) {
+        if (!(*sink)(fragment)) return 0;
+      } else {
+        (*sink)(fragment);
+      }
+    } else {
+      if constexpr (std::is_same_v<decltype(sink->Write(fragment)), bool>) {
+        if (!sink->Write(fragment)) return 0;
+      } else {
+        sink->Write(fragment);
+      }
+    }
+  } catch (...) {
+    return 0;
+  }
+
+  return total_size;
+}
+
+// writes the response body to a file stream, aborting once it fails
+template <typename RxFileT>
+struct FileSink {
+  using view_type = std::basic_string_view<typename RxFileT::char_type,
+                                           typename RxFileT::traits_type>;
+
+  RxFileT* file = nullptr;
+
+  bool operator()(view_type fragment) {
+    file->write(fragment.data(), fragment.size());
+    return file->good();
+  }
+};
+
+// appends the response body to a string, reserved from Content-Length
+template <typename StringT>
+struct StringSink {
+  using view_type = std::basic_string_view<typename StringT::value_type,
+                                           typename StringT::traits_type>;
+
+  StringT* target = nullptr;
+
+  void operator()(view_type fragment) { target->append(fragment); }
+
+  void Reserve(size_t total_bytes) {
+    target->reserve(target->size() +
+                    std::min(total_bytes, max_body_reservation));
+  }
+};
+
 // for downloads
 // previously asserted open flags
 // user to establish preconditions
@@ -80,9 +288,10 @@ template <typename RxFileT>
 size_t ResponseFileCallback(typename RxFileT::char_type* contents,
                             size_t byte_size, size_t total_count,
                             RxFileT* file) {
-  size_t total_size = total_count * byte_size;
-  file->write(contents, total_size);
-  return total_size;
+  FileSink<RxFileT> sink{file};
+  return ResponseSinkCallback<FileSink<RxFileT>, typename RxFileT::char_type,
+                              typename RxFileT::traits_type>(
+      contents, byte_size, total_count, &sink);
 }
 
 template <typename StringT>
@@ -90,9 +299,10 @@ size_t ResponseBodyStringCallback(
     typename StringT::traits_type::char_type* contents,
     typename StringT::size_type byte_size,
     typename StringT::size_type total_count, StringT* target) {
-  typename StringT::size_type total_size = total_count * byte_size;
-  target->append(contents, total_size);
-  return total_size;
+  StringSink<StringT> sink{target};
+  return ResponseSinkCallback<StringSink<StringT>, typename StringT::value_type,
+                              typename StringT::traits_type>(
+      contents, byte_size, total_count, &sink);
 }
 
 template <typename Rep>
@@ -155,9 +365,18 @@ inline int DefaultProgressCallback(TransferSpeedMonitor<int64_t, double>* log,
   auto rx_prec = (total_downloaded - log->receive.current_y()) >= 1;
   auto tx_prec = (total_uploaded - log->send.current_y()) >= 1;
 
+  log->smoothed_receive.Sample(
+      rx_prec ? static_cast<double>(total_downloaded - log->receive.current_y())
+              : 0.0,
+      time_interval);
+  log->smoothed_send.Sample(
+      tx_prec ? static_cast<double>(total_uploaded - log->send.current_y())
+              : 0.0,
+      time_interval);
+
   if (tx_prec) {
     log->send.ChangeY(total_uploaded);
-    auto tx_rate = log->send.Differential();
+    auto tx_rate = log->smoothed_send.rate();
     auto [n_bytes, str_bytes] = BytesCountString(total_uploaded);
     auto [tn_bytes, tn_str_bytes] = BytesCountString(to_upload);
     auto [n_rate, str_rate] = BytesCountString(tx_rate);
@@ -168,7 +387,7 @@ inline int DefaultProgressCallback(TransferSpeedMonitor<int64_t, double>* log,
 
   if (rx_prec) {
     log->receive.ChangeY(total_downloaded);
-    auto rx_rate = log->receive.Differential();
+    auto rx_rate = log->smoothed_receive.rate();
     auto [n_bytes, str_bytes] = BytesCountString(total_downloaded);
     auto [tn_bytes, tn_str_bytes] = BytesCountString(to_download);
     auto [n_rate, str_rate] = BytesCountString(rx_rate);
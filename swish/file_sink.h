@@ -0,0 +1,269 @@
+#ifndef ______lib_SWISH___file_sink_h
+#define ______lib_SWISH___file_sink_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+// preallocated file writes require POSIX file and memory mapping apis
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#define SWISH_HAS_FILE_SINK 1
+
+namespace swish {
+
+enum class FileWriteMode {
+  // positioned writes straight to the file descriptor
+  PWrite = 0,
+
+  // copies into a shared memory mapped window of the file, falls back to
+  // PWrite past the reserved length or when the length is not known
+  Mapped = 1
+};
+
+struct FileSinkOptions {
+  FileWriteMode mode = FileWriteMode::PWrite;
+
+  // file offset the first received byte is written at
+  uint64_t offset = 0;
+
+  // discard previous contents on open and cut off unused preallocated space on
+  // commit, disable when several sinks write parts of the same file
+  bool truncate = true;
+
+  // bytes mapped at once in Mapped mode, rounded to whole pages
+  size_t window_size = 64 * 1024 * 1024;
+};
+
+/**
+ * @brief Response sink downloading into a file without stream buffering.
+ *
+ * Space for the body is preallocated from its Content-Length so the file does
+ * not grow write by write, then received fragments are written with pwrite or
+ * copied into a mapped window of the file. Commit() flushes the data to disk
+ * and must be called once the transfer succeeded, Client::Download does so.
+ * Flush() persists a partial download without releasing the reservation.
+ */
+class PreallocatedFileSink {
+  FileSinkOptions options_{};
+  int fd_ = -1;
+
+  uint64_t written_ = 0;
+  uint64_t reserved_ = 0;
+
+  char* window_ = nullptr;
+  uint64_t window_offset_ = 0;
+  size_t window_length_ = 0;
+
+  static size_t PageSize() {
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return page_size;
+  }
+
+  void Unmap() {
+    if (window_ == nullptr) return;
+
+    // starts write back, completed by fdatasync on commit
+    msync(window_, window_length_, MS_ASYNC);
+    munmap(window_, window_length_);
+
+    window_ = nullptr;
+    window_length_ = 0;
+  }
+
+  // maps the window holding [position], false if it is past the reservation
+  bool MapWindow(uint64_t position) {
+    uint64_t reserved_end = options_.offset + reserved_;
+    if (position >= reserved_end) return false;
+
+    if (window_ != nullptr && position >= window_offset_ &&
+        position < window_offset_ + window_length_)
+      return true;
+
+    Unmap();
+
+    size_t page_size = PageSize();
+    size_t window_size =
+        std::max(page_size, options_.window_size / page_size * page_size);
+
+    uint64_t offset = position / page_size * page_size;
+    size_t length = static_cast<size_t>(
+        std::min<uint64_t>(window_size, reserved_end - offset));
+
+    void* window = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd_, static_cast<off_t>(offset));
+    if (window == MAP_FAILED) return false;
+
+    window_ = static_cast<char*>(window);
+    window_offset_ = offset;
+    window_length_ = length;
+    return true;
+  }
+
+  bool PWrite(const char* data, size_t size, uint64_t position) {
+    while (size > 0) {
+      ssize_t count = pwrite(fd_, data, size, static_cast<off_t>(position));
+      if (count < 0) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+
+      data += count;
+      size -= static_cast<size_t>(count);
+      position += static_cast<uint64_t>(count);
+    }
+    return true;
+  }
+
+ public:
+  explicit PreallocatedFileSink(const std::string& path,
+                                const FileSinkOptions& options = {})
+      : options_{options} {
+    fd_ = open(path.c_str(),
+               O_RDWR | O_CREAT | (options_.truncate ? O_TRUNC : 0), 0644);
+  }
+
+  bool is_open() const { return fd_ != -1; }
+
+  // number of bytes received so far
+  uint64_t written() const { return written_; }
+
+  const FileSinkOptions& options() const { return options_; }
+
+  /**
+   * @brief preallocates [total_bytes] from the sink's offset, called with the
+   * Content-Length of the response
+   *
+   */
+  void Reserve(size_t total_bytes) {
+    if (!is_open() || total_bytes <= reserved_) return;
+
+    off_t offset = static_cast<off_t>(options_.offset);
+    off_t length = static_cast<off_t>(total_bytes);
+    bool allocated = false;
+
+#if defined(__linux__)
+    allocated = fallocate(fd_, 0, offset, length) == 0;
+#endif
+
+    // mapping requires the file to span the window, a sparse extension will do
+    if (!allocated) {
+      struct stat file_stat {};
+      if (fstat(fd_, &file_stat) != 0) return;
+      if (file_stat.st_size < offset + length &&
+          ftruncate(fd_, offset + length) != 0)
+        return;
+    }
+
+    reserved_ = total_bytes;
+  }
+
+  bool Write(std::string_view fragment) {
+    if (!is_open()) return false;
+
+    const char* data = fragment.data();
+    size_t size = fragment.size();
+    uint64_t position = options_.offset + written_;
+
+    if (options_.mode == FileWriteMode::Mapped) {
+      while (size > 0 && MapWindow(position)) {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(
+            size, window_offset_ + window_length_ - position));
+        std::memcpy(window_ + (position - window_offset_), data, count);
+
+        data += count;
+        size -= count;
+        position += count;
+      }
+    }
+
+    if (size > 0 && !PWrite(data, size, position)) return false;
+
+    written_ += fragment.size();
+    return true;
+  }
+
+  /**
+   * @brief flushes everything written to disk and releases unused
+   * preallocated space, false if the data could not be persisted
+   *
+   */
+  bool Commit() {
+    if (!is_open()) return false;
+
+    if (window_ != nullptr && msync(window_, window_length_, MS_SYNC) != 0)
+      return false;
+    Unmap();
+
+    if (options_.truncate && written_ < reserved_ &&
+        ftruncate(fd_, static_cast<off_t>(options_.offset + written_)) != 0)
+      return false;
+
+    return Flush();
+  }
+
+  /**
+   * @brief flushes everything written so far to disk while the transfer goes
+   * on, false if the data could not be persisted
+   *
+   */
+  bool Flush() {
+    if (!is_open()) return false;
+
+    if (window_ != nullptr && msync(window_, window_length_, MS_SYNC) != 0)
+      return false;
+
+#if defined(__APPLE__)
+    return fsync(fd_) == 0;
+#else
+    return fdatasync(fd_) == 0;
+#endif
+  }
+
+  PreallocatedFileSink(const PreallocatedFileSink&) = delete;
+
+  PreallocatedFileSink& operator=(const PreallocatedFileSink&) = delete;
+
+  ~PreallocatedFileSink() noexcept {
+    Unmap();
+    if (is_open()) close(fd_);
+  }
+};
+
+};  // namespace swish
+
+#endif
+
+#endif
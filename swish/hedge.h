@@ -0,0 +1,139 @@
+#ifndef ______lib_SWISH___hedge_h
+#define ______lib_SWISH___hedge_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "metrics.h"
+#include "retry.h"
+
+namespace swish {
+
+/**
+ * @brief Hedging of GET and HEAD requests: once a request has gone without a
+ * first byte for a while, a duplicate is sent on a second handle. The first
+ * of the two to complete successfully wins and the other is aborted.
+ *
+ * Hedges are taken from a token bucket so they stay a bounded fraction of
+ * the requests made, even while a host is slow across the board.
+ */
+struct HedgePolicy {
+  bool enabled = false;
+
+  // a duplicate is sent after this long without a first byte. If 0, the
+  // host's time to first byte at [quantile] as recorded in the configured
+  // Metrics is used, or [fallback_delay] while none is configured or it has
+  // fewer than [minimum_samples]
+  std::chrono::milliseconds delay{0};
+  double quantile = 0.95;
+  uint64_t minimum_samples = 20;
+  std::chrono::milliseconds fallback_delay{200};
+
+  // hedges are withdrawn from it, unbounded if null
+  RetryBudget* budget = &Budget();
+
+  // process-wide hedge budget, about one hedge per 20 requests
+  static RetryBudget& Budget() {
+    static RetryBudget budget{0.05, 1, 10};
+    return budget;
+  }
+
+  /**
+   * @brief how long a request of [host] waits for its first byte before it
+   * is hedged, going by [metrics] if not null
+   *
+   */
+  std::chrono::microseconds Delay(const Metrics* metrics,
+                                  std::string_view host) const {
+    if (delay.count() > 0 || metrics == nullptr) return FixedDelay();
+
+    LatencyHistogram time_to_first_byte = metrics->TimeToFirstByte(host);
+    if (time_to_first_byte.count < minimum_samples) return FixedDelay();
+
+    return std::chrono::microseconds{time_to_first_byte.Percentile(quantile)};
+  }
+
+ private:
+  std::chrono::microseconds FixedDelay() const {
+    return delay.count() > 0 ? delay : fallback_delay;
+  }
+};
+
+/**
+ * @brief Hedge delays of the hosts a client requests. A host's delay is
+ * looked up in the Metrics at most once per [refresh_interval], not on every
+ * request, as merging its histograms takes the registry lock.
+ *
+ */
+class HedgeDelays {
+  using clock = std::chrono::steady_clock;
+
+  struct Entry {
+    std::chrono::microseconds delay{0};
+    clock::time_point refreshed{};
+  };
+
+  static constexpr std::chrono::seconds refresh_interval{1};
+
+  // hosts kept at most, the cache is cleared when it is full
+  static constexpr size_t capacity = 256;
+
+  std::map<std::string, Entry, std::less<>> hosts_{};
+
+ public:
+  /**
+   * @brief how long a request of [host] under [policy] waits for its first
+   * byte before it is hedged, going by [metrics] if not null
+   *
+   */
+  std::chrono::microseconds Get(const HedgePolicy& policy,
+                                const Metrics* metrics,
+                                std::string_view host) {
+    if (policy.delay.count() > 0 || metrics == nullptr)
+      return policy.Delay(metrics, host);
+
+    clock::time_point now = clock::now();
+
+    auto entry = hosts_.find(host);
+    if (entry == hosts_.end()) {
+      if (hosts_.size() >= capacity) hosts_.clear();
+      entry = hosts_.emplace(std::string{host}, Entry{}).first;
+    } else if (now - entry->second.refreshed < refresh_interval) {
+      return entry->second.delay;
+    }
+
+    entry->second = Entry{policy.Delay(metrics, host), now};
+    return entry->second.delay;
+  }
+};
+
+};  // namespace swish
+
+#endif
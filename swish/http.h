@@ -25,6 +25,8 @@
  * 
  */
 
+#include <string_view>
+
 #include <curl/curl.h>
 #include <curl/easy.h>
 
@@ -99,6 +101,20 @@ enum class ResponseCode {
   HTTPVersionNotSupported = 505,
   NetworkAuthenticationRequired = 511
 };
+
+// host and port of [url], without its scheme, credentials and path
+inline std::string_view UrlHost(std::string_view url) {
+  size_t scheme_end = url.find("://");
+  if (scheme_end != std::string_view::npos) url.remove_prefix(scheme_end + 3);
+
+  url = url.substr(0, url.find_first_of("/?#"));
+
+  size_t credentials_end = url.rfind('@');
+  if (credentials_end != std::string_view::npos)
+    url.remove_prefix(credentials_end + 1);
+
+  return url;
+}
 };
 };  // namespace swish
 #endif
\ No newline at end of file
@@ -26,13 +26,47 @@
  */
 #include <cstring>
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
 #include <memory>
+#include <new>
 #include <string>
 #include <vector>
 
 namespace swish {
 // internal use only
 
+// most bytes reserved up front from a Content-Length the server announced,
+// bodies beyond it grow as they are received
+inline constexpr size_t max_body_reservation = 64 * 1024 * 1024;
+
+// how a BasicResponseBuffer stores what it receives
+enum class BufferMode {
+  // one allocation per libcurl write callback
+  Chunks = 0,
+
+  // fills fixed size slabs, only allocating once the current one is full
+  Slabs = 1,
+
+  // a single block sized from the Content-Length of the response, growing
+  // geometrically when the length is not known up front
+  Contiguous = 2
+};
+
+struct ResponseBufferOptions {
+  BufferMode mode = BufferMode::Chunks;
+
+  // number of bytes per slab
+  size_t slab_size = 256 * 1024;
+
+  // back slabs with transparent huge pages, linux only
+  bool huge_pages = false;
+};
+
 // read only buffer
 template <typename ByteType = char,
           typename ByteTraits = std::char_traits<ByteType>,
@@ -42,72 +76,203 @@ class BasicResponseBuffer {
   using byte_type = ByteType;
   using byte_traits = ByteTraits;
   using allocator_type = Allocator;
-  using size_type = typename allocator_type::size_type;
-  using pointer = typename allocator_type::pointer;
+  using size_type = typename std::allocator_traits<allocator_type>::size_type;
+  using pointer = typename std::allocator_traits<allocator_type>::pointer;
+  using string_type = std::basic_string<byte_type, byte_traits, allocator_type>;
 
  private:
   allocator_type allocator_{};
+  ResponseBufferOptions options_{};
   size_type size_ = 0;
+  size_type allocation_count_ = 0;
+  // chunk or slab, and the number of bytes used in it
   std::vector<std::pair<pointer, size_type>> chunks_;
 
- public:
-  const std::vector<std::pair<pointer, size_type>>& chunks() const {
-    return chunks_;
+  // storage in contiguous mode, chunks_ then holds a single view of it
+  string_type contiguous_{};
+  size_type expected_size_ = 0;
+
+  bool MapsSlabs() const {
+#if defined(__linux__)
+    return options_.mode == BufferMode::Slabs && options_.huge_pages;
+#else
+    return false;
+#endif
   }
 
-  BasicResponseBuffer() = default;
+  pointer Allocate(size_type count) {
+    allocation_count_++;
 
-  BasicResponseBuffer(const BasicResponseBuffer& to_copy) {
-    for (const auto& chunk : to_copy.chunks_)
-      this->PushCopy(chunk.first, chunk.second);
+#if defined(__linux__)
+    if (MapsSlabs()) {
+      void* slab = mmap(nullptr, count * sizeof(byte_type),
+                        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1, 0);
+      if (slab == MAP_FAILED) throw std::bad_alloc{};
+
+      madvise(slab, count * sizeof(byte_type), MADV_HUGEPAGE);
+      return static_cast<pointer>(slab);
+    }
+#endif
+
+    return allocator_.allocate(count);
   }
 
-  BasicResponseBuffer(BasicResponseBuffer&& to_move) {
-    for (auto& chunk : to_move.chunks_) {
-      chunks_.emplace_back(chunk.first, chunk.second);
+  void Deallocate(pointer data, size_type count) {
+#if defined(__linux__)
+    if (MapsSlabs()) {
+      munmap(data, count * sizeof(byte_type));
+      return;
+    }
+#endif
 
-      chunk.first = nullptr;
-      chunk.second = 0;
+    allocator_.deallocate(data, count);
+  }
+
+  void Release() {
+    if (options_.mode != BufferMode::Contiguous) {
+      for (auto& [data, used] : chunks_)
+        Deallocate(data, options_.mode == BufferMode::Slabs
+                             ? options_.slab_size
+                             : used);
     }
+    chunks_.clear();
+    contiguous_ = string_type{};
+    size_ = 0;
+  }
 
+  void Steal(BasicResponseBuffer& to_move) {
+    options_ = to_move.options_;
+    chunks_ = std::move(to_move.chunks_);
+    contiguous_ = std::move(to_move.contiguous_);
     size_ = to_move.size_;
+    allocation_count_ = to_move.allocation_count_;
+    expected_size_ = to_move.expected_size_;
+
+    // the string's storage may have moved along with it
+    if (options_.mode == BufferMode::Contiguous) SyncContiguous();
+
+    to_move.chunks_.clear();
+    to_move.contiguous_.clear();
     to_move.size_ = 0;
+    to_move.allocation_count_ = 0;
+    to_move.expected_size_ = 0;
   }
 
+  void SyncContiguous() {
+    chunks_.clear();
+    if (size_ > 0) chunks_.emplace_back(contiguous_.data(), size_);
+  }
+
+  void PushToContiguous(const byte_type* data, size_type total_bytes) {
+    size_type capacity = contiguous_.capacity();
+
+    if (size_ + total_bytes > capacity) {
+      contiguous_.reserve(std::max(size_ + total_bytes,
+                                   std::max(expected_size_, 2 * capacity)));
+      allocation_count_++;
+    }
+
+    contiguous_.append(data, total_bytes);
+    size_ += total_bytes;
+    SyncContiguous();
+  }
+
+  void PushToSlabs(const byte_type* data, size_type total_bytes) {
+    while (total_bytes > 0) {
+      if (chunks_.empty() || chunks_.back().second == options_.slab_size)
+        chunks_.emplace_back(Allocate(options_.slab_size), 0);
+
+      auto& [slab, used] = chunks_.back();
+      size_type count = std::min(total_bytes, options_.slab_size - used);
+
+      std::memcpy(slab + used, data, count);
+      used += count;
+      size_ += count;
+
+      data += count;
+      total_bytes -= count;
+    }
+  }
+
+ public:
+  const std::vector<std::pair<pointer, size_type>>& chunks() const {
+    return chunks_;
+  }
+
+  BasicResponseBuffer() = default;
+
+  explicit BasicResponseBuffer(const ResponseBufferOptions& options)
+      : options_{options} {
+    if (options_.slab_size == 0) options_.mode = BufferMode::Chunks;
+  }
+
+  BasicResponseBuffer(const BasicResponseBuffer& to_copy)
+      : options_{to_copy.options_} {
+    for (const auto& chunk : to_copy.chunks_)
+      this->PushCopy(chunk.first, chunk.second);
+  }
+
+  BasicResponseBuffer(BasicResponseBuffer&& to_move) { Steal(to_move); }
+
   BasicResponseBuffer& operator=(const BasicResponseBuffer& to_copy) {
+    if (this == &to_copy) return *this;
+
+    Release();
+    options_ = to_copy.options_;
     for (const auto& chunk : to_copy.chunks_)
       this->PushCopy(chunk.first, chunk.second);
     return *this;
   }
 
   BasicResponseBuffer& operator=(BasicResponseBuffer&& to_move) {
-    for (auto& chunk : to_move.chunks_) {
-      chunks_.emplace_back(chunk.first, chunk.second);
-
-      chunk.first = nullptr;
-      chunk.second = 0;
-    }
-
-    size_ = to_move.size_;
-    to_move.size_ = 0;
+    if (this == &to_move) return *this;
 
+    Release();
+    Steal(to_move);
     return *this;
   }
 
-  ~BasicResponseBuffer() noexcept {
-    for (auto& chunk : chunks_) {
-      allocator_.deallocate(chunk.first, chunk.second);
-    }
-  }
+  ~BasicResponseBuffer() noexcept { Release(); }
 
   size_type total_size() const { return size_; }
 
-  std::basic_string<byte_type, byte_traits, allocator_type> ToString() const {
-    std::basic_string<byte_type, byte_traits, allocator_type> result{};
+  // number of allocations made to store the received bytes
+  size_type allocation_count() const { return allocation_count_; }
+
+  const ResponseBufferOptions& options() const { return options_; }
+
+  string_type ToString() const& {
+    if (options_.mode == BufferMode::Contiguous) return contiguous_;
+
+    string_type result{};
+    result.reserve(size_);
     for (const auto& [buff, count] : chunks_) {
       result.append(buff, count);
     }
-    return std::move(result);
+    return result;
+  }
+
+  // in contiguous mode, moves the body out without copying it
+  string_type ToString() && {
+    if (options_.mode != BufferMode::Contiguous)
+      return static_cast<const BasicResponseBuffer&>(*this).ToString();
+
+    string_type result = std::move(contiguous_);
+    contiguous_.clear();
+    chunks_.clear();
+    size_ = 0;
+    return result;
+  }
+
+  /**
+   * @brief announces [total_bytes] are about to be received, in contiguous
+   * mode the first write allocates the whole of them at once, up to
+   * max_body_reservation
+   *
+   */
+  void Reserve(size_type total_bytes) {
+    expected_size_ = std::min<size_type>(total_bytes, max_body_reservation);
   }
 
   void Save(std::basic_ofstream<byte_type, byte_traits>* file) {
@@ -116,8 +281,18 @@ class BasicResponseBuffer {
     }
   }
 
-  void PushCopy(pointer data, size_type total_bytes) {
-    pointer data_handle = allocator_.allocate(total_bytes);
+  void PushCopy(const byte_type* data, size_type total_bytes) {
+    if (options_.mode == BufferMode::Slabs) {
+      PushToSlabs(data, total_bytes);
+      return;
+    }
+
+    if (options_.mode == BufferMode::Contiguous) {
+      PushToContiguous(data, total_bytes);
+      return;
+    }
+
+    pointer data_handle = Allocate(total_bytes);
     std::memcpy(data_handle, data, total_bytes);
     chunks_.emplace_back(data_handle, total_bytes);
     size_ += total_bytes;
@@ -132,8 +307,8 @@ class BasicRequestBuffer {
   using byte_type = ByteType;
   using allocator_type = Allocator;
   using byte_traits = ByteTraits;
-  using pointer = typename allocator_type::pointer;
-  using size_type = typename allocator_type::size_type;
+  using pointer = typename std::allocator_traits<allocator_type>::pointer;
+  using size_type = typename std::allocator_traits<allocator_type>::size_type;
   using string_type = std::basic_string<byte_type, byte_traits, allocator_type>;
 
  private:
@@ -154,19 +329,17 @@ class BasicRequestBuffer {
   size_type size() const { return xbuffer_->size(); }
 
   size_type Write(byte_type* destination, size_type dest_size) {
-    // when read position reaches end of sequence return zero to signify end
-    // ensure size_t doesn't go negative
-    // caution!!!
-
-    size_type source_size = xbuffer_->size();
-    size_type left_to_write = source_size - write_position_;
+    // when read position reaches end of sequence return zero to signify end,
+    // [dest_size] is in bytes, positions are in byte_type
+    size_type left_to_write = xbuffer_->size() - write_position_;
     size_type current_write_range =
-        dest_size > left_to_write ? left_to_write : dest_size;
+        std::min<size_type>(dest_size / sizeof(byte_type), left_to_write);
     if (current_write_range == 0) return 0;
 
-    std::memcpy(destination, xbuffer_->begin().base(), current_write_range);
+    std::memcpy(destination, xbuffer_->data() + write_position_,
+                current_write_range * sizeof(byte_type));
     write_position_ += current_write_range;
-    return current_write_range;
+    return current_write_range * sizeof(byte_type);
   }
 };
 
@@ -176,7 +349,5 @@ using ResponseBodyBuffer = BasicResponseBuffer<T>;
 template <typename T>
 using RequestBodyBuffer = BasicRequestBuffer<T>;
 
-typedef BasicResponseBuffer<char> ResponseHeaderBuffer;
-
 };  // namespace swish
 #endif
\ No newline at end of file
@@ -0,0 +1,628 @@
+#ifndef ______lib_SWISH___metrics_h
+#define ______lib_SWISH___metrics_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "http.h"
+#include "status_codes.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace swish {
+
+/**
+ * @brief Latency distribution in microseconds, bucketed like an HDR
+ * histogram.
+ *
+ * Values are grouped by their highest set bit and every power of two range
+ * is split into 16 linear sub-buckets, so a recorded value is known to within
+ * 1/16th of itself from 1us to 2^40us with a fixed number of buckets.
+ */
+struct LatencyHistogram {
+  static constexpr unsigned sub_bucket_bits = 4;
+  static constexpr uint64_t sub_bucket_count = uint64_t{1} << sub_bucket_bits;
+  static constexpr unsigned maximum_bits = 40;
+  static constexpr uint64_t maximum_value = (uint64_t{1} << maximum_bits) - 1;
+  static constexpr size_t bucket_count =
+      (maximum_bits - sub_bucket_bits + 1) * sub_bucket_count;
+
+  std::vector<uint64_t> counts = std::vector<uint64_t>(bucket_count, 0);
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t max = 0;
+
+  static unsigned HighestSetBit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanReverse64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+  }
+
+  static size_t BucketIndex(uint64_t value) {
+    if (value > maximum_value) value = maximum_value;
+    if (value < sub_bucket_count) return static_cast<size_t>(value);
+
+    unsigned shift = HighestSetBit(value) - sub_bucket_bits;
+    return static_cast<size_t>(shift * sub_bucket_count + (value >> shift));
+  }
+
+  // smallest value recorded in bucket [index]
+  static uint64_t BucketLowerBound(size_t index) {
+    if (index < 2 * sub_bucket_count) return index;
+
+    unsigned shift = static_cast<unsigned>(index / sub_bucket_count - 1);
+    return (index - shift * sub_bucket_count) << shift;
+  }
+
+  void Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < bucket_count; i++) counts[i] += other.counts[i];
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+  }
+
+  /**
+   * @brief upper bound of the [quantile] of recorded values, e.g. 0.99 for the
+   * 99th percentile, 0 if none were recorded
+   *
+   */
+  uint64_t Percentile(double quantile) const {
+    if (count == 0) return 0;
+
+    uint64_t rank = static_cast<uint64_t>(
+        std::ceil(std::min(std::max(quantile, 0.0), 1.0) * count));
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+      seen += counts[i];
+      if (seen >= rank) {
+        uint64_t upper = i + 1 < bucket_count ? BucketLowerBound(i + 1) - 1
+                                              : maximum_value;
+        return std::min(upper, max);
+      }
+    }
+    return max;
+  }
+
+  double Mean() const {
+    return count == 0 ? 0.0
+                      : static_cast<double>(sum) / static_cast<double>(count);
+  }
+};
+
+// everything recorded for one host, summed over every thread
+struct HostMetrics {
+  uint64_t requests = 0;
+  uint64_t bytes_received = 0;
+  uint64_t bytes_sent = 0;
+  uint64_t connections_opened = 0;
+  uint64_t connections_reused = 0;
+
+  // transfers that failed, by the status they failed with
+  std::map<StatusCode, uint64_t> errors{};
+
+  // completed responses by HTTP status code, including error codes
+  std::map<int64_t, uint64_t> response_codes{};
+
+  LatencyHistogram time_to_first_byte{};
+  LatencyHistogram total_time{};
+};
+
+struct MetricsSnapshot {
+  std::map<std::string, HostMetrics> hosts{};
+
+  /**
+   * @brief renders the snapshot in the Prometheus text exposition format,
+   * latencies as their 50th, 90th, 99th and 99.9th percentiles
+   *
+   */
+  std::string ToText() const {
+    std::string text{};
+
+    auto label = [](const std::string& host) {
+      std::string escaped{};
+      for (char c : host) {
+        if (c == '"' || c == '\\') escaped.push_back('\\');
+        escaped.push_back(c);
+      }
+      return "host=\"" + escaped + "\"";
+    };
+
+    auto counter = [&](const char* name, auto value_of) {
+      text.append("# TYPE ").append(name).append(" counter\n");
+      for (const auto& [host, metrics] : hosts)
+        value_of(label(host), metrics);
+    };
+
+    auto line = [&](const char* name, const std::string& labels,
+                    uint64_t value) {
+      text.append(name)
+          .append("{")
+          .append(labels)
+          .append("} ")
+          .append(std::to_string(value))
+          .append("\n");
+    };
+
+    counter("swish_requests_total",
+            [&](const std::string& labels, const HostMetrics& metrics) {
+              line("swish_requests_total", labels, metrics.requests);
+            });
+
+    counter("swish_errors_total",
+            [&](const std::string& labels, const HostMetrics& metrics) {
+              for (const auto& [status, count] : metrics.errors)
+                line("swish_errors_total",
+                     labels + ",status=\"" +
+                         std::to_string(static_cast<int>(status)) + "\"",
+                     count);
+            });
+
+    counter("swish_responses_total",
+            [&](const std::string& labels, const HostMetrics& metrics) {
+              for (const auto& [code, count] : metrics.response_codes)
+                line("swish_responses_total",
+                     labels + ",code=\"" + std::to_string(code) + "\"", count);
+            });
+
+    counter("swish_received_bytes_total",
+            [&](const std::string& labels, const HostMetrics& metrics) {
+              line("swish_received_bytes_total", labels,
+                   metrics.bytes_received);
+            });
+
+    counter("swish_sent_bytes_total",
+            [&](const std::string& labels, const HostMetrics& metrics) {
+              line("swish_sent_bytes_total", labels, metrics.bytes_sent);
+            });
+
+    counter("swish_connections_total",
+            [&](const std::string& labels, const HostMetrics& metrics) {
+              line("swish_connections_total", labels + ",reused=\"false\"",
+                   metrics.connections_opened);
+              line("swish_connections_total", labels + ",reused=\"true\"",
+                   metrics.connections_reused);
+            });
+
+    // labels are spelled out rather than formatted, which would follow the
+    // locale
+    static constexpr std::pair<double, const char*> quantiles[] = {
+        {0.5, "0.5"}, {0.9, "0.9"}, {0.99, "0.99"}, {0.999, "0.999"}};
+
+    auto summary = [&](const std::string& name,
+                       LatencyHistogram HostMetrics::*histogram) {
+      text.append("# TYPE ").append(name).append(" summary\n");
+      for (const auto& [host, metrics] : hosts) {
+        const LatencyHistogram& latency = metrics.*histogram;
+        std::string labels = label(host);
+
+        for (const auto& [quantile, label] : quantiles)
+          line(name.c_str(), labels + ",quantile=\"" + label + "\"",
+               latency.Percentile(quantile));
+
+        line((name + "_sum").c_str(), labels, latency.sum);
+        line((name + "_count").c_str(), labels, latency.count);
+      }
+    };
+
+    summary("swish_time_to_first_byte_microseconds",
+            &HostMetrics::time_to_first_byte);
+    summary("swish_total_time_microseconds", &HostMetrics::total_time);
+
+    return text;
+  }
+};
+
+/**
+ * @brief Registry of client-side request metrics, grouped by host.
+ *
+ * Every thread records into a shard of its own with relaxed atomic stores,
+ * so recording a transfer takes no lock and contends with no other thread.
+ * A thread only locks the registry the first time it records into it.
+ * Snapshot() merges the shards, and may see a transfer recorded in some of
+ * its counters and not yet in others. The shard of a thread is merged into
+ * the registry's totals and freed once the thread exits.
+ *
+ * Clients record every transfer into Configuration::metrics if it is set.
+ */
+class Metrics {
+  // a histogram only written by the thread owning its shard
+  struct AtomicHistogram {
+    std::array<std::atomic<uint64_t>, LatencyHistogram::bucket_count>
+        counts{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+
+    void Record(uint64_t value) {
+      Increment(&counts[LatencyHistogram::BucketIndex(value)], 1);
+      Increment(&count, 1);
+      Increment(&sum, value);
+      if (value > max.load(std::memory_order_relaxed))
+        max.store(value, std::memory_order_relaxed);
+    }
+
+    void CopyTo(LatencyHistogram* histogram) const {
+      LatencyHistogram shard{};
+      for (size_t i = 0; i < LatencyHistogram::bucket_count; i++)
+        shard.counts[i] = counts[i].load(std::memory_order_relaxed);
+      shard.count = count.load(std::memory_order_relaxed);
+      shard.sum = sum.load(std::memory_order_relaxed);
+      shard.max = max.load(std::memory_order_relaxed);
+      histogram->Merge(shard);
+    }
+  };
+
+  // HTTP status codes counted individually, the rest as 0
+  static constexpr size_t response_code_slots = 600;
+  static constexpr size_t status_code_slots = CURL_LAST + 16;
+
+  struct HostCounters {
+    // set before the counters are published to other threads
+    std::string host{};
+
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> bytes_received{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> connections_opened{0};
+    std::atomic<uint64_t> connections_reused{0};
+    std::array<std::atomic<uint64_t>, status_code_slots> errors{};
+    std::array<std::atomic<uint64_t>, response_code_slots> response_codes{};
+
+    AtomicHistogram time_to_first_byte{};
+    AtomicHistogram total_time{};
+  };
+
+  // hosts past the capacity of a shard are recorded as one
+  static constexpr size_t host_slots = 256;
+  static constexpr std::string_view other_hosts = "(other)";
+
+  struct Shard {
+    std::array<std::atomic<HostCounters*>, host_slots> hosts{};
+    std::atomic<HostCounters*> other{nullptr};
+
+    static HostCounters* Publish(std::atomic<HostCounters*>* slot,
+                                 std::string_view host) {
+      auto counters = std::make_unique<HostCounters>();
+      counters->host = host;
+      slot->store(counters.get(), std::memory_order_release);
+      return counters.release();
+    }
+
+    static uint64_t Hash(std::string_view host) {
+      uint64_t hash = 14695981039346656037ull;
+      for (char c : host) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+      }
+      return hash;
+    }
+
+    // counters of [host], created on first use by the owning thread
+    HostCounters* Find(std::string_view host) {
+      uint64_t hash = Hash(host);
+
+      for (size_t probe = 0; probe < host_slots; probe++) {
+        auto& slot = hosts[(hash + probe) % host_slots];
+        HostCounters* counters = slot.load(std::memory_order_relaxed);
+        if (counters == nullptr) return Publish(&slot, host);
+        if (counters->host == host) return counters;
+      }
+
+      HostCounters* counters = other.load(std::memory_order_relaxed);
+      return counters != nullptr ? counters : Publish(&other, other_hosts);
+    }
+
+    // counters of [host] if the owning thread created them, from any thread
+    const HostCounters* Lookup(std::string_view host) const {
+      uint64_t hash = Hash(host);
+
+      for (size_t probe = 0; probe < host_slots; probe++) {
+        const HostCounters* counters =
+            hosts[(hash + probe) % host_slots].load(std::memory_order_acquire);
+        if (counters == nullptr) return nullptr;
+        if (counters->host == host) return counters;
+      }
+
+      return nullptr;
+    }
+
+    Shard() = default;
+
+    Shard(const Shard&) = delete;
+
+    Shard& operator=(const Shard&) = delete;
+
+    ~Shard() noexcept {
+      for (auto& slot : hosts) delete slot.load(std::memory_order_relaxed);
+      delete other.load(std::memory_order_relaxed);
+    }
+  };
+
+  mutable std::mutex mutex_{};
+  std::vector<std::unique_ptr<Shard>> shards_{};
+
+  // what the shards of exited threads recorded, hosts past the capacity of a
+  // shard are recorded as one
+  MetricsSnapshot retired_{};
+
+  // tells registries apart in the thread local shard cache, addresses may be
+  // reused
+  uint64_t id_ = 0;
+
+  static uint64_t NextId() {
+    static std::atomic<uint64_t> next_id{1};
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // a single writer needs no read-modify-write
+  static void Increment(std::atomic<uint64_t>* counter, uint64_t value) {
+    counter->store(counter->load(std::memory_order_relaxed) + value,
+                   std::memory_order_relaxed);
+  }
+
+  // registries alive by id, so an exiting thread only retires its shards into
+  // the ones not destroyed yet
+  static std::mutex& RegistriesMutex() {
+    static std::mutex mutex{};
+    return mutex;
+  }
+
+  static std::map<uint64_t, Metrics*>& Registries() {
+    static std::map<uint64_t, Metrics*> registries{};
+    return registries;
+  }
+
+  // the shards of a thread, retired when it exits
+  struct LocalShards {
+    std::vector<std::pair<uint64_t, Shard*>> shards{};
+
+    ~LocalShards() noexcept {
+      std::lock_guard lock{RegistriesMutex()};
+      for (const auto& [id, shard] : shards) {
+        auto registry = Registries().find(id);
+        if (registry != Registries().end()) registry->second->Retire(shard);
+      }
+    }
+  };
+
+  Shard* LocalShard() {
+    thread_local LocalShards local_shards{};
+
+    for (const auto& [id, shard] : local_shards.shards) {
+      if (id == id_) return shard;
+    }
+
+    std::lock_guard lock{mutex_};
+    shards_.push_back(std::make_unique<Shard>());
+    local_shards.shards.emplace_back(id_, shards_.back().get());
+    return shards_.back().get();
+  }
+
+  static void Merge(const HostCounters& counters, HostMetrics* host) {
+    host->requests += counters.requests.load(std::memory_order_relaxed);
+    host->bytes_received +=
+        counters.bytes_received.load(std::memory_order_relaxed);
+    host->bytes_sent += counters.bytes_sent.load(std::memory_order_relaxed);
+    host->connections_opened +=
+        counters.connections_opened.load(std::memory_order_relaxed);
+    host->connections_reused +=
+        counters.connections_reused.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < status_code_slots; i++) {
+      uint64_t count = counters.errors[i].load(std::memory_order_relaxed);
+      if (count != 0) host->errors[static_cast<StatusCode>(i)] += count;
+    }
+
+    for (size_t i = 0; i < response_code_slots; i++) {
+      uint64_t count =
+          counters.response_codes[i].load(std::memory_order_relaxed);
+      if (count != 0) host->response_codes[static_cast<int64_t>(i)] += count;
+    }
+
+    counters.time_to_first_byte.CopyTo(&host->time_to_first_byte);
+    counters.total_time.CopyTo(&host->total_time);
+  }
+
+  // calls [visit] with the counters of every host of [shard]
+  template <typename Visitor>
+  static void ForEachHost(const Shard& shard, Visitor&& visit) {
+    for (const auto& slot : shard.hosts) {
+      const HostCounters* counters = slot.load(std::memory_order_acquire);
+      if (counters != nullptr) visit(*counters);
+    }
+
+    const HostCounters* other = shard.other.load(std::memory_order_acquire);
+    if (other != nullptr) visit(*other);
+  }
+
+  // folds [shard] of an exiting thread into the totals and frees it
+  void Retire(Shard* shard) {
+    std::lock_guard lock{mutex_};
+
+    ForEachHost(*shard, [&](const HostCounters& counters) {
+      auto host = retired_.hosts.find(counters.host);
+      if (host == retired_.hosts.end())
+        host = retired_.hosts
+                   .emplace(retired_.hosts.size() < host_slots
+                                ? counters.host
+                                : std::string{other_hosts},
+                            HostMetrics{})
+                   .first;
+      Merge(counters, &host->second);
+    });
+
+    shards_.erase(std::find_if(shards_.begin(), shards_.end(),
+                               [&](const std::unique_ptr<Shard>& owned) {
+                                 return owned.get() == shard;
+                               }));
+  }
+
+  static uint64_t Info(CURL* handle, CURLINFO info) {
+    curl_off_t value = 0;
+    if (curl_easy_getinfo(handle, info, &value) != CURLE_OK || value < 0)
+      return 0;
+    return static_cast<uint64_t>(value);
+  }
+
+  static uint64_t LongInfo(CURL* handle, CURLINFO info) {
+    long value = 0;
+    if (curl_easy_getinfo(handle, info, &value) != CURLE_OK || value < 0)
+      return 0;
+    return static_cast<uint64_t>(value);
+  }
+
+ public:
+  Metrics() : id_{NextId()} {
+    std::lock_guard lock{RegistriesMutex()};
+    Registries().emplace(id_, this);
+  }
+
+  // the registry clients record into unless configured otherwise
+  static Metrics& Global() {
+    static Metrics metrics{};
+    return metrics;
+  }
+
+  /**
+   * @brief records the finished transfer of [handle], which ended with
+   * [status]
+   *
+   */
+  void Record(CURL* handle, StatusCode status) {
+    char* url = nullptr;
+    curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+
+    HostCounters* counters =
+        LocalShard()->Find(http::UrlHost(url == nullptr ? "" : url));
+
+    Increment(&counters->requests, 1);
+    Increment(&counters->bytes_received,
+              Info(handle, CURLINFO_SIZE_DOWNLOAD_T) +
+                  LongInfo(handle, CURLINFO_HEADER_SIZE));
+    Increment(&counters->bytes_sent, Info(handle, CURLINFO_SIZE_UPLOAD_T) +
+                                         LongInfo(handle, CURLINFO_REQUEST_SIZE));
+
+    uint64_t response_code = LongInfo(handle, CURLINFO_RESPONSE_CODE);
+    uint64_t connects = LongInfo(handle, CURLINFO_NUM_CONNECTS);
+
+    Increment(&counters->connections_opened, connects);
+    // a response without a new connection came over one kept alive
+    if (connects == 0 && response_code != 0)
+      Increment(&counters->connections_reused, 1);
+
+    if (response_code != 0)
+      Increment(&counters->response_codes[response_code < response_code_slots
+                                               ? response_code
+                                               : 0],
+                1);
+
+    if (!IsOK(status)) {
+      size_t slot = static_cast<size_t>(status);
+      Increment(&counters->errors[slot < status_code_slots ? slot : 0], 1);
+    }
+
+    if (response_code != 0)
+      counters->time_to_first_byte.Record(
+          Info(handle, CURLINFO_STARTTRANSFER_TIME_T));
+    counters->total_time.Record(Info(handle, CURLINFO_TOTAL_TIME_T));
+  }
+
+  /**
+   * @brief merges what every thread recorded so far
+   *
+   */
+  MetricsSnapshot Snapshot() const {
+    std::lock_guard lock{mutex_};
+    MetricsSnapshot snapshot = retired_;
+
+    for (const auto& shard : shards_) {
+      ForEachHost(*shard, [&](const HostCounters& counters) {
+        Merge(counters, &snapshot.hosts[counters.host]);
+      });
+    }
+
+    return snapshot;
+  }
+
+  /**
+   * @brief time to first byte of the responses of [host], merged over every
+   * thread without taking a snapshot of the other hosts
+   *
+   */
+  LatencyHistogram TimeToFirstByte(std::string_view host) const {
+    LatencyHistogram histogram{};
+    std::lock_guard lock{mutex_};
+
+    auto retired = retired_.hosts.find(std::string{host});
+    if (retired != retired_.hosts.end())
+      histogram.Merge(retired->second.time_to_first_byte);
+
+    for (const auto& shard : shards_) {
+      const HostCounters* counters = shard->Lookup(host);
+      if (counters != nullptr)
+        counters->time_to_first_byte.CopyTo(&histogram);
+    }
+
+    return histogram;
+  }
+
+  // Snapshot() in the Prometheus text exposition format
+  std::string Dump() const { return Snapshot().ToText(); }
+
+  Metrics(const Metrics&) = delete;
+
+  Metrics& operator=(const Metrics&) = delete;
+
+  ~Metrics() noexcept {
+    std::lock_guard lock{RegistriesMutex()};
+    Registries().erase(id_);
+  }
+};
+
+};  // namespace swish
+
+#endif
@@ -0,0 +1,634 @@
+#ifndef ______lib_SWISH___multi_client_h
+#define ______lib_SWISH___multi_client_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "client.h"
+
+namespace swish {
+
+/**
+ * @brief Concurrent HTTP client, drives any number of transfers on a single
+ * curl_multi handle from the calling thread.
+ *
+ * Requests are submitted with a completion callback and performed when
+ * Perform() or Poll() is called. Every transfer uses [configuration] as it is
+ * at submission time: libcurl copies its options, and the transfer holds its
+ * header lists and shared state until it is done, so the configuration may
+ * change meanwhile. It completes with the same Response type as Client.
+ *
+ * [RxByteType] Type of byte received from the server, char, uint8, int8, etc
+ * [RxByteTraits] The char_traits of the byte type
+ * [RxAllocator] Allocator for server response buffers
+ */
+template <typename RxByteType = char,
+          typename RxByteTraits = std::char_traits<RxByteType>,
+          typename RxAllocator = std::allocator<RxByteType>>
+class BasicMultiClient {
+ public:
+  using rx_byte_type = RxByteType;
+  using rx_byte_traits = RxByteTraits;
+  using rx_allocator_t = RxAllocator;
+  using response_buff_t =
+      BasicResponseBuffer<rx_byte_type, rx_byte_traits, rx_allocator_t>;
+  using response_t = Response<response_buff_t>;
+
+  // invoked once the transfer is done, from within Perform() or Poll()
+  using completion_type = std::function<void(response_t&&, StatusCode)>;
+
+ private:
+  struct Transfer {
+    response_buff_t body{};
+    ResponseHeaderBuffer header{};
+    ResponseHeaderContext<response_buff_t> header_context{};
+    // owns urlencoded form fields until the transfer is done
+    std::string post_data{};
+    // keeps a shared request body alive until the transfer is done
+    RequestBody request_body{};
+    // streamed request body, resumed when data is pushed to it
+    RequestStream* request_stream = nullptr;
+    // header lists the handle points to, kept alive if the configuration's
+    // headers change before the transfer is done
+    std::shared_ptr<curl_slist> request_header{};
+    std::shared_ptr<curl_slist> proxy_header{};
+    // share the handle is attached to, kept alive the same way
+    std::shared_ptr<SharedState> shared_state{};
+    uint32_t response_fields = kAllResponseFields;
+    TransferWatch watch{TransferWatch::Driver::Multi};
+    RetryController attempts{};
+    // the body is handed to a sink as it arrives rather than buffered
+    bool streamed_body = true;
+    completion_type on_complete{};
+  };
+
+  CURLM* multi_handle_ = nullptr;
+
+  std::unordered_map<CURL*, std::unique_ptr<Transfer>> transfers_{};
+
+  // transfers whose request body is streamed, paused while it is empty
+  std::vector<std::pair<CURL*, RequestStream*>> request_streams_{};
+
+  // transfers shaped by a bandwidth governor, they may be paused by it
+  size_t governed_ = 0;
+
+  // failed transfers waiting to be attempted again, and when
+  std::vector<std::pair<std::chrono::steady_clock::time_point, CURL*>>
+      retries_{};
+
+  // finished handles are reset and reused by later transfers rather than
+  // allocated again, responses own their fields
+  std::vector<CURL*> idle_handles_{};
+
+  CURL* AcquireHandle() {
+    if (idle_handles_.empty()) return curl_easy_init();
+
+    CURL* handle = idle_handles_.back();
+    idle_handles_.pop_back();
+    curl_easy_reset(handle);
+    return handle;
+  }
+
+  // detaches [handle] from its share first, whose state is only kept alive
+  // while the transfer lasts
+  void ReleaseHandle(CURL* handle) {
+    curl_easy_setopt(handle, CURLOPT_SHARE, nullptr);
+    idle_handles_.push_back(handle);
+  }
+
+  /**
+   * @brief configures [handle] for [url], attaches [transfer]'s buffers and
+   * adds it to the multi handle. [Setup] applies method specific options.
+   *
+   * Fails with StatusCode::CircuitOpen if the circuit breaker of the host of
+   * [url] is open.
+   */
+  template <typename Setup>
+  StatusCode Submit(std::string_view url, std::unique_ptr<Transfer> transfer,
+                    Setup&& setup) {
+    // a streamed request body is consumed by its first attempt
+    transfer->attempts = RetryController{
+        transfer->request_stream == nullptr ? configuration.retry_policy
+                                            : RetryPolicy{},
+        configuration.circuit_breaker, url, configuration.metrics};
+    if (!transfer->attempts.Admit()) return StatusCode::CircuitOpen;
+
+    CURL* handle = AcquireHandle();
+    if (handle == nullptr) return StatusCode::InitializationError;
+
+    transfer->body = response_buff_t{configuration.response_buffer};
+    transfer->response_fields = configuration.response_fields;
+
+    StatusCode status = configuration.ConfigHandle(handle);
+    if (!IsOK(status)) return Abandon(handle, status);
+    transfer->request_header = configuration.header.shared_slist();
+    transfer->proxy_header = configuration.proxy.header.shared_slist();
+    transfer->shared_state = configuration.shared_state;
+
+    status = static_cast<StatusCode>(
+        curl_easy_setopt(handle, CURLOPT_URL, url.data()));
+    if (!IsOK(status)) return Abandon(handle, status);
+
+    status = static_cast<StatusCode>(
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION,
+                         ResponseBufferCallback<ResponseHeaderBuffer>));
+    if (!IsOK(status)) return Abandon(handle, status);
+
+    status = static_cast<StatusCode>(
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA, &transfer->header));
+    if (!IsOK(status)) return Abandon(handle, status);
+
+    status = setup(handle, transfer.get());
+    if (!IsOK(status)) return Abandon(handle, status);
+
+    status = configuration.Watch(handle, &transfer->watch);
+    if (!IsOK(status)) return Abandon(handle, status);
+
+    if (curl_multi_add_handle(multi_handle_, handle) != CURLM_OK)
+      return Abandon(handle, StatusCode::InitializationError);
+
+    if (transfer->request_stream != nullptr) {
+      transfer->request_stream->Attach(multi_handle_);
+      request_streams_.emplace_back(handle, transfer->request_stream);
+    }
+
+    if (transfer->watch.governed()) governed_++;
+    transfers_.emplace(handle, std::move(transfer));
+
+    return StatusCode::OK;
+  }
+
+  StatusCode Abandon(CURL* handle, StatusCode status) {
+    ReleaseHandle(handle);
+    return status;
+  }
+
+  static StatusCode WriteToBuffer(CURL* handle, Transfer* transfer) {
+    transfer->header_context = {&transfer->header, &transfer->body};
+    transfer->streamed_body = false;
+
+    StatusCode status = static_cast<StatusCode>(
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION,
+                         ResponseHeaderReserveCallback<response_buff_t>));
+    if (!IsOK(status)) return status;
+
+    status = static_cast<StatusCode>(
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA, &transfer->header_context));
+    if (!IsOK(status)) return status;
+
+    status = static_cast<StatusCode>(
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION,
+                         ResponseBufferCallback<response_buff_t>));
+    if (!IsOK(status)) return status;
+
+    return static_cast<StatusCode>(
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &transfer->body));
+  }
+
+  // unpauses streamed uploads that were pushed data since they ran dry,
+  // unless their governor holds them back
+  void ResumeStreams() {
+    for (auto& [handle, stream] : request_streams_) {
+      auto transfer = transfers_.find(handle);
+      stream->ResumeTransfer(handle, transfer != transfers_.end() &&
+                                         transfer->second->watch.throttled());
+    }
+  }
+
+  // unpauses governed transfers whose traffic class has budget again, returns
+  // how long until the next one may be resumed
+  std::chrono::milliseconds ResumeThrottled() {
+    auto wait = std::chrono::milliseconds::max();
+    if (governed_ == 0) return wait;
+
+    for (auto& [handle, transfer] : transfers_) {
+      // a streamed upload waiting for data is left paused
+      auto delay = transfer->watch.ResumeThrottled(
+          transfer->request_stream != nullptr &&
+          transfer->request_stream->paused());
+      if (delay == TransferWatch::clock::duration::max()) continue;
+      wait = std::min(
+          wait, std::max(std::chrono::ceil<std::chrono::milliseconds>(delay),
+                         std::chrono::milliseconds{1}));
+    }
+
+    return wait;
+  }
+
+  void DetachStream(CURL* handle) {
+    auto stream = std::find_if(
+        request_streams_.begin(), request_streams_.end(),
+        [handle](const auto& entry) { return entry.first == handle; });
+    if (stream == request_streams_.end()) return;
+
+    stream->second->Detach();
+    request_streams_.erase(stream);
+  }
+
+  // hands the transfer of [handle] to its completion callback
+  void Complete(CURL* handle, StatusCode status) {
+    auto node = transfers_.extract(handle);
+    std::unique_ptr<Transfer> transfer = std::move(node.mapped());
+
+    if (transfer->request_stream != nullptr) DetachStream(handle);
+    if (transfer->watch.governed()) governed_--;
+    transfer->watch.Finish(status);
+
+    response_t response{};
+    response.Prepare(handle, std::move(transfer->body),
+                     std::move(transfer->header), transfer->response_fields);
+    response.throughput_ = transfer->watch.throughput();
+
+    if (transfer->on_complete)
+      transfer->on_complete(std::move(response), status);
+
+    ReleaseHandle(handle);
+  }
+
+  // adds back the transfers due for another attempt on their handle, returns
+  // how long until the next one is due
+  std::chrono::milliseconds StartRetries() {
+    auto wait = std::chrono::milliseconds::max();
+    auto now = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < retries_.size();) {
+      auto [due, handle] = retries_[i];
+      if (due > now) {
+        wait = std::min(wait, std::chrono::ceil<std::chrono::milliseconds>(
+                                  due - now));
+        i++;
+        continue;
+      }
+
+      retries_[i] = retries_.back();
+      retries_.pop_back();
+
+      if (curl_multi_add_handle(multi_handle_, handle) != CURLM_OK)
+        Complete(handle, StatusCode::InitializationError);
+    }
+
+    return wait;
+  }
+
+  // hands every finished transfer to its completion callback, or sets it
+  // aside for another attempt
+  void Dispatch() {
+    CURLMsg* message = nullptr;
+    int queued = 0;
+
+    while ((message = curl_multi_info_read(multi_handle_, &queued)) !=
+           nullptr) {
+      if (message->msg != CURLMSG_DONE) continue;
+
+      // message is invalidated by curl_multi_remove_handle
+      CURL* handle = message->easy_handle;
+      StatusCode status = static_cast<StatusCode>(message->data.result);
+
+      curl_multi_remove_handle(multi_handle_, handle);
+
+      Transfer& transfer = *transfers_.at(handle);
+      auto delay = transfer.attempts.Next(handle, status, transfer.header,
+                                          transfer.streamed_body);
+      if (!delay.has_value()) {
+        Complete(handle, status);
+        continue;
+      }
+
+      transfer.body = response_buff_t{transfer.body.options()};
+      transfer.header.Clear();
+      transfer.watch.Restart();
+      retries_.emplace_back(std::chrono::steady_clock::now() + *delay, handle);
+    }
+  }
+
+ public:
+  Configuration configuration{};
+
+  BasicMultiClient() : multi_handle_(curl_multi_init()) {
+    assert(multi_handle_ != nullptr);
+  }
+
+  /**
+   * @brief Submits a GET request, the response body is stored in a vector of
+   * buffers
+   *
+   */
+  StatusCode Get(std::string_view url, completion_type on_complete) {
+    auto transfer = std::make_unique<Transfer>();
+    transfer->on_complete = std::move(on_complete);
+
+    return Submit(url, std::move(transfer), [](CURL* handle, Transfer* t) {
+      return WriteToBuffer(handle, t);
+    });
+  }
+
+  /**
+   * @brief Submits a HEAD request
+   *
+   */
+  StatusCode Head(std::string_view url, completion_type on_complete) {
+    auto transfer = std::make_unique<Transfer>();
+    transfer->on_complete = std::move(on_complete);
+
+    return Submit(url, std::move(transfer), [](CURL* handle, Transfer* t) {
+      StatusCode status = static_cast<StatusCode>(
+          curl_easy_setopt(handle, CURLOPT_NOBODY, 1L));
+      if (!IsOK(status)) return status;
+
+      return WriteToBuffer(handle, t);
+    });
+  }
+
+  /**
+   * @brief Submits a DELETE request
+   *
+   */
+  StatusCode Delete(std::string_view url, completion_type on_complete) {
+    auto transfer = std::make_unique<Transfer>();
+    transfer->on_complete = std::move(on_complete);
+
+    return Submit(url, std::move(transfer), [](CURL* handle, Transfer* t) {
+      StatusCode status = static_cast<StatusCode>(
+          curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "DELETE"));
+      if (!IsOK(status)) return status;
+
+      return WriteToBuffer(handle, t);
+    });
+  }
+
+  /**
+   * @brief Submits a POST request of Content-Type:
+   * application/x-www-form-urlencoded, [post_fields] being any range of
+   * key/value pairs. Strings are posted as they are
+   *
+   */
+  template <typename FormDataT = FormData,
+            typename = std::enable_if_t<is_form_data<FormDataT>::value>>
+  StatusCode Post(std::string_view url, const FormDataT& post_fields,
+                  completion_type on_complete) {
+    if (!(post_fields.size() > 0))
+      throw std::range_error{"Post Fields can not be empty"};
+
+    auto transfer = std::make_unique<Transfer>();
+    transfer->on_complete = std::move(on_complete);
+    transfer->post_data = JoinFormData(post_fields);
+
+    return Submit(url, std::move(transfer), [](CURL* handle, Transfer* t) {
+      StatusCode status = static_cast<StatusCode>(
+          curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE,
+                           static_cast<curl_off_t>(t->post_data.size())));
+      if (!IsOK(status)) return status;
+
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(handle, CURLOPT_POSTFIELDS, t->post_data.c_str()));
+      if (!IsOK(status)) return status;
+
+      return WriteToBuffer(handle, t);
+    });
+  }
+
+  /**
+   * @brief Submits a POST request with [body] as its request body, handed to
+   * libcurl in place. Memory the body does not own must outlive the transfer.
+   *
+   */
+  StatusCode Post(std::string_view url, RequestBody body,
+                  completion_type on_complete) {
+    auto transfer = std::make_unique<Transfer>();
+    transfer->on_complete = std::move(on_complete);
+    transfer->request_body = std::move(body);
+
+    return Submit(url, std::move(transfer), [](CURL* handle, Transfer* t) {
+      StatusCode status = t->request_body.ConfigHandle(handle);
+      if (!IsOK(status)) return status;
+
+      return WriteToBuffer(handle, t);
+    });
+  }
+
+  /**
+   * @brief Submits a POST request with [data] as its body, [data] must outlive
+   * the transfer
+   *
+   */
+  template <typename TxByteType = char,
+            typename TxByteTraits = std::char_traits<TxByteType>,
+            typename TxAllocator = std::allocator<TxByteType>>
+  StatusCode Post(
+      std::string_view url,
+      const std::basic_string<TxByteType, TxByteTraits, TxAllocator>* data,
+      completion_type on_complete) {
+    return Post(url, RequestBody{*data}, std::move(on_complete));
+  }
+
+  /**
+   * @brief Submits a POST request whose body is pushed to [stream] by another
+   * thread while it is being sent, [stream] must outlive the transfer
+   *
+   */
+  StatusCode Post(std::string_view url, RequestStream* stream,
+                  completion_type on_complete) {
+    auto transfer = std::make_unique<Transfer>();
+    transfer->on_complete = std::move(on_complete);
+    transfer->request_stream = stream;
+
+    return Submit(url, std::move(transfer), [](CURL* handle, Transfer* t) {
+      StatusCode status = static_cast<StatusCode>(
+          curl_easy_setopt(handle, CURLOPT_POST, 1L));
+      if (!IsOK(status)) return status;
+
+      status = static_cast<StatusCode>(curl_easy_setopt(
+          handle, CURLOPT_READFUNCTION, RequestStream::ReadCallback));
+      if (!IsOK(status)) return status;
+
+      status = static_cast<StatusCode>(
+          curl_easy_setopt(handle, CURLOPT_READDATA, t->request_stream));
+      if (!IsOK(status)) return status;
+
+      return WriteToBuffer(handle, t);
+    });
+  }
+
+  /**
+   * @brief Submits a GET request that downloads the response body into
+   * [file], [file] must outlive the transfer
+   *
+   */
+  StatusCode Download(std::string_view url,
+                      std::basic_ofstream<rx_byte_type, rx_byte_traits>* file,
+                      completion_type on_complete) {
+    using rx_file_t = std::basic_ofstream<rx_byte_type, rx_byte_traits>;
+
+    auto transfer = std::make_unique<Transfer>();
+    transfer->on_complete = std::move(on_complete);
+
+    return Submit(url, std::move(transfer), [file](CURL* handle, Transfer*) {
+      StatusCode status = static_cast<StatusCode>(curl_easy_setopt(
+          handle, CURLOPT_WRITEFUNCTION, ResponseFileCallback<rx_file_t>));
+      if (!IsOK(status)) return status;
+
+      return static_cast<StatusCode>(
+          curl_easy_setopt(handle, CURLOPT_WRITEDATA, file));
+    });
+  }
+
+  /**
+   * @brief Submits a GET request that stores the response body in [target],
+   * [target] must outlive the transfer
+   *
+   */
+  StatusCode Download(
+      std::string_view url,
+      std::basic_string<rx_byte_type, rx_byte_traits, rx_allocator_t>* target,
+      completion_type on_complete) {
+    using rx_str_t =
+        std::basic_string<rx_byte_type, rx_byte_traits, rx_allocator_t>;
+
+    auto transfer = std::make_unique<Transfer>();
+    transfer->on_complete = std::move(on_complete);
+
+    return Submit(url, std::move(transfer), [target](CURL* handle, Transfer*) {
+      StatusCode status = static_cast<StatusCode>(curl_easy_setopt(
+          handle, CURLOPT_WRITEFUNCTION, ResponseBodyStringCallback<rx_str_t>));
+      if (!IsOK(status)) return status;
+
+      return static_cast<StatusCode>(
+          curl_easy_setopt(handle, CURLOPT_WRITEDATA, target));
+    });
+  }
+
+  /**
+   * @brief Submits a GET request that hands every fragment of the response
+   * body to [sink] as it is received, see Client::Stream. [sink] must outlive
+   * the transfer
+   *
+   */
+  template <typename Sink_t>
+  StatusCode Stream(std::string_view url, Sink_t* sink,
+                    completion_type on_complete) {
+    auto transfer = std::make_unique<Transfer>();
+    transfer->on_complete = std::move(on_complete);
+
+    return Submit(url, std::move(transfer), [sink](CURL* handle, Transfer*) {
+      StatusCode status = static_cast<StatusCode>(curl_easy_setopt(
+          handle, CURLOPT_WRITEFUNCTION,
+          (ResponseSinkCallback<Sink_t, rx_byte_type, rx_byte_traits>)));
+      if (!IsOK(status)) return status;
+
+      return static_cast<StatusCode>(
+          curl_easy_setopt(handle, CURLOPT_WRITEDATA, sink));
+    });
+  }
+
+  /**
+   * @brief Performs a single round of transfers, waiting at most [timeout] for
+   * socket activity. Completion callbacks are invoked from within this call.
+   *
+   * returns the number of transfers still in flight
+   */
+  size_t Poll(std::chrono::milliseconds timeout) {
+    int running = 0;
+
+    ResumeStreams();
+    ResumeThrottled();
+    StartRetries();
+    curl_multi_perform(multi_handle_, &running);
+    Dispatch();
+
+    if (running > 0 || !retries_.empty()) {
+      // throttled transfers are resumed and retries started on time
+      timeout = std::min({timeout, ResumeThrottled(), StartRetries()});
+      curl_multi_poll(multi_handle_, nullptr, 0,
+                      static_cast<int>(timeout.count()), nullptr);
+      ResumeStreams();
+      ResumeThrottled();
+      StartRetries();
+      curl_multi_perform(multi_handle_, &running);
+      Dispatch();
+    }
+
+    return transfers_.size();
+  }
+
+  /**
+   * @brief Performs all submitted transfers, including those submitted from
+   * completion callbacks, and returns once none is left
+   *
+   */
+  void Perform() {
+    while (!transfers_.empty()) Poll(std::chrono::milliseconds{1000});
+  }
+
+  /**
+   * @brief wakes up a Poll() blocked on socket activity, may be called from any
+   * thread
+   *
+   */
+  void Wakeup() { curl_multi_wakeup(multi_handle_); }
+
+  // number of transfers submitted and not yet completed
+  size_t pending() const { return transfers_.size(); }
+
+  CURLM* multi_handle() { return multi_handle_; }
+
+  BasicMultiClient(const BasicMultiClient&) = delete;
+
+  BasicMultiClient& operator=(const BasicMultiClient&) = delete;
+
+  BasicMultiClient(BasicMultiClient&&) = delete;
+
+  BasicMultiClient& operator=(BasicMultiClient&&) = delete;
+
+  ~BasicMultiClient() noexcept {
+    for (auto& [handle, stream] : request_streams_) stream->Detach();
+
+    for (auto& [handle, transfer] : transfers_) {
+      curl_multi_remove_handle(multi_handle_, handle);
+      curl_easy_cleanup(handle);
+    }
+
+    for (CURL* handle : idle_handles_) curl_easy_cleanup(handle);
+
+    curl_multi_cleanup(multi_handle_);
+  }
+};
+
+typedef BasicMultiClient<char> MultiClient;
+
+};  // namespace swish
+
+#endif
@@ -0,0 +1,327 @@
+#ifndef ______lib_SWISH___prepared_request_h
+#define ______lib_SWISH___prepared_request_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include <curl/curl.h>
+
+#include "client.h"
+
+namespace swish {
+
+/**
+ * @brief A request configured once and sent any number of times.
+ *
+ * The configuration, url, method and callbacks are pushed to a dedicated
+ * handle when the request is prepared. Send() then only pushes what varies
+ * between sends, the body or a suffix of the url, and performs the transfer
+ * on the handle, reusing its connection.
+ *
+ * Responses own all their data and stay valid after later sends.
+ *
+ * [RxByteType] Type of byte received from the server, char, uint8, int8, etc
+ * [RxByteTraits] The char_traits of the byte type
+ * [RxAllocator] Allocator for server response buffers
+ */
+template <typename RxByteType = char,
+          typename RxByteTraits = std::char_traits<RxByteType>,
+          typename RxAllocator = std::allocator<RxByteType>>
+class BasicPreparedRequest {
+ public:
+  using rx_byte_type = RxByteType;
+  using rx_byte_traits = RxByteTraits;
+  using rx_allocator_t = RxAllocator;
+  using response_buff_t =
+      BasicResponseBuffer<rx_byte_type, rx_byte_traits, rx_allocator_t>;
+  using response_t = Response<response_buff_t>;
+
+  enum class Method { Get, Head, Delete, Post };
+
+ private:
+  CURL* handle_ = nullptr;
+  Method method_ = Method::Get;
+  StatusCode status_ = StatusCode::OK;
+
+  // owns the header lists and progress data the handle points to, at a
+  // stable address so the request can be moved
+  std::unique_ptr<Configuration> configuration_{};
+  AppliedConfiguration applied_{};
+
+  std::string url_{};
+  // url of the last send, only pushed again when it differs
+  std::string sent_url_{};
+
+  BasicPreparedRequest() = default;
+
+  StatusCode ConfigMethod() {
+    switch (method_) {
+      case Method::Head:
+        return static_cast<StatusCode>(
+            curl_easy_setopt(handle_, CURLOPT_NOBODY, 1L));
+      case Method::Delete:
+        return static_cast<StatusCode>(
+            curl_easy_setopt(handle_, CURLOPT_CUSTOMREQUEST, "DELETE"));
+      case Method::Post:
+        return RequestBody{}.ConfigHandle(handle_);
+      default:
+        return StatusCode::OK;
+    }
+  }
+
+  StatusCode ConfigCallbacks() {
+    StatusCode status = static_cast<StatusCode>(
+        curl_easy_setopt(handle_, CURLOPT_WRITEFUNCTION,
+                         ResponseBufferCallback<response_buff_t>));
+    if (!IsOK(status)) return status;
+
+    return static_cast<StatusCode>(
+        curl_easy_setopt(handle_, CURLOPT_HEADERFUNCTION,
+                         ResponseHeaderReserveCallback<response_buff_t>));
+  }
+
+  StatusCode ConfigUrl(std::string_view url_suffix) {
+    if (sent_url_.size() == url_.size() + url_suffix.size() &&
+        std::string_view{sent_url_}.substr(url_.size()) == url_suffix)
+      return StatusCode::OK;
+
+    sent_url_.assign(url_).append(url_suffix);
+
+    StatusCode status = static_cast<StatusCode>(
+        curl_easy_setopt(handle_, CURLOPT_URL, sent_url_.c_str()));
+    // pushed again on the next send
+    if (!IsOK(status)) sent_url_.clear();
+    return status;
+  }
+
+  std::pair<response_t, StatusCode> Perform() {
+    response_buff_t body{configuration_->response_buffer};
+    ResponseHeaderBuffer header{};
+    ResponseHeaderContext<response_buff_t> header_context{&header, &body};
+
+    StatusCode status = static_cast<StatusCode>(
+        curl_easy_setopt(handle_, CURLOPT_WRITEDATA, &body));
+    if (!IsOK(status)) return std::make_pair(response_t{}, status);
+
+    status = static_cast<StatusCode>(
+        curl_easy_setopt(handle_, CURLOPT_HEADERDATA, &header_context));
+    if (!IsOK(status)) return std::make_pair(response_t{}, status);
+
+    RetryController attempts{configuration_->retry_policy,
+                             configuration_->circuit_breaker, sent_url_,
+                             configuration_->metrics};
+    if (!attempts.Admit())
+      return std::make_pair(response_t{}, StatusCode::CircuitOpen);
+
+    TransferWatch watch{};
+    status = configuration_->Watch(handle_, &watch, &applied_);
+    if (!IsOK(status)) return std::make_pair(response_t{}, status);
+
+    // attempts are made on the handle, reusing its connection
+    status = attempts.Perform(
+        [this] { return static_cast<StatusCode>(curl_easy_perform(handle_)); },
+        [this] { return handle_; }, header, false,
+        [&] {
+          body = response_buff_t{body.options()};
+          header.Clear();
+          watch.Restart();
+        });
+
+    watch.Finish(status);
+
+    response_t response{};
+    response.Prepare(handle_, std::move(body), std::move(header),
+                     configuration_->response_fields);
+    response.throughput_ = watch.throughput();
+
+    return std::make_pair(std::move(response), status);
+  }
+
+ public:
+  /**
+   * @brief prepares a [method] request of [url] with a copy of
+   * [configuration], status() tells whether it succeeded
+   *
+   */
+  explicit BasicPreparedRequest(std::string_view url,
+                                const Configuration& configuration = {},
+                                Method method = Method::Get)
+      : handle_{curl_easy_init()},
+        method_{method},
+        configuration_{std::make_unique<Configuration>(configuration)},
+        url_{url} {
+    if (handle_ == nullptr) {
+      status_ = StatusCode::InitializationError;
+      return;
+    }
+
+    status_ = configuration_->ConfigHandle(handle_, &applied_);
+    if (!IsOK(status_)) return;
+
+    status_ = ConfigMethod();
+    if (!IsOK(status_)) return;
+
+    status_ = ConfigCallbacks();
+    if (!IsOK(status_)) return;
+
+    status_ = ConfigUrl({});
+  }
+
+  // result of preparing the request, sends fail with it if it is not OK
+  StatusCode status() const { return status_; }
+
+  Method method() const { return method_; }
+
+  const std::string& url() const { return url_; }
+
+  const Configuration& configuration() const { return *configuration_; }
+
+  /**
+   * @brief sends the request as prepared
+   *
+   */
+  std::pair<response_t, StatusCode> Send() { return Send({}, RequestBody{}); }
+
+  /**
+   * @brief sends the request to the prepared url followed by [url_suffix],
+   * e.g. a path or query. Bodies are always passed as a RequestBody.
+   *
+   */
+  std::pair<response_t, StatusCode> Send(std::string_view url_suffix) {
+    return Send(url_suffix, RequestBody{});
+  }
+
+  std::pair<response_t, StatusCode> Send(const char* url_suffix) {
+    return Send(std::string_view{url_suffix}, RequestBody{});
+  }
+
+  std::pair<response_t, StatusCode> Send(const std::string& url_suffix) {
+    return Send(std::string_view{url_suffix}, RequestBody{});
+  }
+
+  /**
+   * @brief sends a POST request with [body] handed to libcurl in place
+   *
+   */
+  std::pair<response_t, StatusCode> Send(const RequestBody& body) {
+    return Send({}, body);
+  }
+
+  std::pair<response_t, StatusCode> Send(std::string_view url_suffix,
+                                         const RequestBody& body) {
+    if (!IsOK(status_)) return std::make_pair(response_t{}, status_);
+
+    StatusCode status = ConfigUrl(url_suffix);
+    if (!IsOK(status)) return std::make_pair(response_t{}, status);
+
+    if (!body.empty()) {
+      status = body.ConfigHandle(handle_);
+      if (!IsOK(status)) return std::make_pair(response_t{}, status);
+    }
+
+    auto result = Perform();
+
+    // the handle must not keep pointing to the caller's body
+    if (!body.empty()) {
+      curl_easy_setopt(handle_, CURLOPT_POSTFIELDSIZE_LARGE,
+                       static_cast<curl_off_t>(-1));
+      curl_easy_setopt(handle_, CURLOPT_POSTFIELDS, nullptr);
+      curl_easy_setopt(handle_, CURLOPT_HTTPGET, 1L);
+      ConfigMethod();
+    }
+
+    return result;
+  }
+
+  /**
+   * @brief copies the prepared request onto a new handle with
+   * curl_easy_duphandle, e.g. to send it from another thread
+   *
+   */
+  BasicPreparedRequest Clone() const {
+    BasicPreparedRequest clone{};
+    clone.method_ = method_;
+    clone.status_ = status_;
+    clone.configuration_ = std::make_unique<Configuration>(*configuration_);
+    clone.applied_ = applied_;
+    clone.url_ = url_;
+
+    clone.handle_ = curl_easy_duphandle(handle_);
+    if (clone.handle_ == nullptr) {
+      clone.status_ = StatusCode::InitializationError;
+      return clone;
+    }
+
+    if (!IsOK(clone.status_)) return clone;
+
+    // only the header lists and progress data of the copy are pushed, they
+    // live at new addresses
+    clone.status_ =
+        clone.configuration_->ConfigHandle(clone.handle_, &clone.applied_);
+    if (!IsOK(clone.status_)) return clone;
+
+    clone.status_ = clone.ConfigUrl({});
+    return clone;
+  }
+
+  BasicPreparedRequest(const BasicPreparedRequest&) = delete;
+
+  BasicPreparedRequest& operator=(const BasicPreparedRequest&) = delete;
+
+  BasicPreparedRequest(BasicPreparedRequest&& other) noexcept
+      : handle_{std::exchange(other.handle_, nullptr)},
+        method_{other.method_},
+        status_{other.status_},
+        configuration_{std::move(other.configuration_)},
+        applied_{std::move(other.applied_)},
+        url_{std::move(other.url_)},
+        sent_url_{std::move(other.sent_url_)} {}
+
+  BasicPreparedRequest& operator=(BasicPreparedRequest&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    std::swap(method_, other.method_);
+    std::swap(status_, other.status_);
+    std::swap(configuration_, other.configuration_);
+    std::swap(applied_, other.applied_);
+    std::swap(url_, other.url_);
+    std::swap(sent_url_, other.sent_url_);
+    return *this;
+  }
+
+  ~BasicPreparedRequest() noexcept {
+    if (handle_ != nullptr) curl_easy_cleanup(handle_);
+  }
+};
+
+typedef BasicPreparedRequest<char> PreparedRequest;
+
+};  // namespace swish
+
+#endif
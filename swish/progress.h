@@ -0,0 +1,336 @@
+#ifndef ______lib_SWISH___progress_h
+#define ______lib_SWISH___progress_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "xcurses.h"
+
+namespace swish {
+
+/**
+ * @brief Progress of one transfer, written by libcurl's progress callback
+ * with relaxed atomic stores and read by a ProgressRenderer.
+ *
+ * Set Configuration::progress_slot to a slot to have the next request report
+ * into it. A slot tracks a single transfer at a time, clients finish it once
+ * the transfer is done.
+ */
+class ProgressSlot {
+  std::string label_{};
+
+  std::atomic<uint64_t> downloaded_{0};
+  std::atomic<uint64_t> download_total_{0};
+  std::atomic<uint64_t> uploaded_{0};
+  std::atomic<uint64_t> upload_total_{0};
+  std::atomic<bool> finished_{false};
+
+  static void Store(std::atomic<uint64_t>* counter, curl_off_t value) {
+    counter->store(value < 0 ? 0 : static_cast<uint64_t>(value),
+                   std::memory_order_relaxed);
+  }
+
+ public:
+  explicit ProgressSlot(std::string label) : label_{std::move(label)} {}
+
+  const std::string& label() const { return label_; }
+
+  uint64_t downloaded() const {
+    return downloaded_.load(std::memory_order_relaxed);
+  }
+
+  // 0 while the size of the download is not known
+  uint64_t download_total() const {
+    return download_total_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t uploaded() const { return uploaded_.load(std::memory_order_relaxed); }
+
+  uint64_t upload_total() const {
+    return upload_total_.load(std::memory_order_relaxed);
+  }
+
+  // marks the transfer done, it is drawn a last time and then left as is
+  void Finish() { finished_.store(true, std::memory_order_relaxed); }
+
+  bool finished() const { return finished_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief libcurl transfer info callback with a ProgressSlot as its data
+   *
+   */
+  static int Callback(void* data, curl_off_t download_total,
+                      curl_off_t downloaded, curl_off_t upload_total,
+                      curl_off_t uploaded) {
+    ProgressSlot* slot = static_cast<ProgressSlot*>(data);
+    Store(&slot->download_total_, download_total);
+    Store(&slot->downloaded_, downloaded);
+    Store(&slot->upload_total_, upload_total);
+    Store(&slot->uploaded_, uploaded);
+    return 0;
+  }
+
+  ProgressSlot(const ProgressSlot&) = delete;
+
+  ProgressSlot& operator=(const ProgressSlot&) = delete;
+};
+
+/**
+ * @brief Draws a progress bar per tracked transfer from a thread of its own.
+ *
+ * Transfers only store their progress into their slot, the renderer redraws
+ * every bar at a fixed frame rate with one write to [stream] per frame, so
+ * the cost of drawing does not grow with the number of progress ticks. Lines
+ * are formatted with std::to_chars into buffers reused from frame to frame.
+ *
+ * A slot is drawn a last time and left on screen once it is finished or
+ * nothing but the renderer refers to it anymore.
+ */
+class ProgressRenderer {
+  struct Entry {
+    std::shared_ptr<ProgressSlot> slot;
+    uint64_t last_bytes = 0;
+    // bytes per second, smoothed over frames
+    double rate = 0;
+    // drawn a last time in the current frame
+    bool done = false;
+  };
+
+  static constexpr size_t bar_width = 30;
+  static constexpr size_t label_width = 24;
+  static constexpr size_t line_capacity = 160;
+
+  std::ostream* stream_ = nullptr;
+  std::chrono::microseconds frame_interval_{};
+
+  std::mutex mutex_{};
+  std::condition_variable stop_signal_{};
+  bool stopped_ = false;
+  // slots tracked since the last frame
+  std::vector<std::shared_ptr<ProgressSlot>> added_{};
+
+  // only used by the rendering thread
+  std::vector<Entry> entries_{};
+  std::string frame_{};
+  size_t lines_drawn_ = 0;
+
+  std::thread thread_{};
+
+  static char* Append(char* out, char* end, std::string_view text) {
+    size_t count = std::min<size_t>(text.size(), end - out);
+    std::copy_n(text.data(), count, out);
+    return out + count;
+  }
+
+  // appends [bytes] as e.g. 12.3 MB, followed by [suffix]
+  static char* AppendBytes(char* out, char* end, double bytes,
+                           std::string_view suffix = {}) {
+    static constexpr std::string_view units[] = {"B", "KB", "MB", "GB", "TB"};
+    size_t unit = 0;
+    while (bytes >= 1000 && unit + 1 < std::size(units)) {
+      bytes /= 1000;
+      unit++;
+    }
+
+    uint64_t tenths = static_cast<uint64_t>(bytes * 10 + 0.5);
+    out = std::to_chars(out, end, tenths / 10).ptr;
+    if (unit > 0) {
+      out = Append(out, end, ".");
+      out = std::to_chars(out, end, tenths % 10).ptr;
+    }
+
+    out = Append(out, end, " ");
+    out = Append(out, end, units[unit]);
+    return Append(out, end, suffix);
+  }
+
+  // formats the line of [entry] into [line], returns its end
+  static char* FormatLine(char* line, const Entry& entry) {
+    char* end = line + line_capacity;
+    const ProgressSlot& slot = *entry.slot;
+
+    bool uploading = slot.downloaded() == 0 && slot.download_total() == 0 &&
+                     (slot.uploaded() > 0 || slot.upload_total() > 0);
+    uint64_t done = uploading ? slot.uploaded() : slot.downloaded();
+    uint64_t total = uploading ? slot.upload_total() : slot.download_total();
+
+    std::string_view label = slot.label();
+    label = label.substr(0, label_width);
+    char* out = Append(line, end, label);
+    for (size_t i = label.size(); i < label_width; i++)
+      out = Append(out, end, " ");
+
+    out = Append(out, end, uploading ? " up " : " ");
+
+    if (total > 0) {
+      uint64_t percent = std::min<uint64_t>(done * 100 / total, 100);
+      size_t filled = static_cast<size_t>(percent * bar_width / 100);
+
+      out = Append(out, end, "[");
+      for (size_t i = 0; i < bar_width; i++)
+        out = Append(out, end, i < filled ? "=" : i == filled ? ">" : " ");
+      out = Append(out, end, "] ");
+
+      if (percent < 100) out = Append(out, end, " ");
+      if (percent < 10) out = Append(out, end, " ");
+      out = std::to_chars(out, end, percent).ptr;
+      out = Append(out, end, "% ");
+    }
+
+    out = AppendBytes(out, end, static_cast<double>(done));
+    if (total > 0) {
+      out = Append(out, end, " of ");
+      out = AppendBytes(out, end, static_cast<double>(total));
+    }
+
+    out = Append(out, end, " at ");
+    out = AppendBytes(out, end, entry.rate, "/s");
+    return Append(out, end, "\n");
+  }
+
+  void Frame(std::chrono::microseconds elapsed) {
+    {
+      std::lock_guard lock{mutex_};
+      for (auto& slot : added_) entries_.push_back(Entry{std::move(slot)});
+      added_.clear();
+    }
+
+    if (entries_.empty() && lines_drawn_ == 0) return;
+
+    double seconds = std::max<int64_t>(elapsed.count(), 1) / 1e6;
+    for (Entry& entry : entries_) {
+      const ProgressSlot& slot = *entry.slot;
+      entry.done = slot.finished() || entry.slot.use_count() == 1;
+
+      uint64_t bytes = slot.downloaded() + slot.uploaded();
+      double rate = (bytes - std::min(bytes, entry.last_bytes)) / seconds;
+      entry.rate = entry.rate == 0 ? rate : entry.rate * 0.7 + rate * 0.3;
+      entry.last_bytes = bytes;
+    }
+
+    char line[line_capacity];
+    frame_.clear();
+
+    // the cursor goes back up over the previous frame, which is cleared
+    if (lines_drawn_ > 0) {
+      frame_.append(xcurses::Cursor::esc_);
+      frame_.append(line, std::to_chars(line, line + line_capacity,
+                                        lines_drawn_).ptr);
+      frame_.push_back('A');
+    }
+    frame_.append(xcurses::Cursor::esc_).append("0J");
+
+    // finished transfers are drawn above the ones still running, and left on
+    // screen
+    for (const Entry& entry : entries_) {
+      if (entry.done) frame_.append(line, FormatLine(line, entry));
+    }
+    for (const Entry& entry : entries_) {
+      if (!entry.done) frame_.append(line, FormatLine(line, entry));
+    }
+
+    stream_->write(frame_.data(), static_cast<std::streamsize>(frame_.size()));
+    stream_->flush();
+
+    entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+                                  [](const Entry& entry) { return entry.done; }),
+                   entries_.end());
+    lines_drawn_ = entries_.size();
+  }
+
+  void Run() {
+    auto last_frame = std::chrono::steady_clock::now();
+    std::unique_lock lock{mutex_};
+
+    while (true) {
+      bool stopped = stop_signal_.wait_for(lock, frame_interval_,
+                                           [this] { return stopped_; });
+      lock.unlock();
+
+      auto now = std::chrono::steady_clock::now();
+      Frame(std::chrono::duration_cast<std::chrono::microseconds>(
+          now - last_frame));
+      last_frame = now;
+
+      if (stopped) return;
+      lock.lock();
+    }
+  }
+
+ public:
+  explicit ProgressRenderer(std::ostream* stream = &std::cout,
+                            unsigned frames_per_second = 10)
+      : stream_{stream},
+        frame_interval_{std::chrono::microseconds{1000000} /
+                        std::max(frames_per_second, 1u)} {
+    thread_ = std::thread{&ProgressRenderer::Run, this};
+  }
+
+  /**
+   * @brief adds a bar labelled [label] and returns its slot, to be set as
+   * Configuration::progress_slot of the transfer it shows
+   *
+   */
+  std::shared_ptr<ProgressSlot> Track(std::string label) {
+    auto slot = std::make_shared<ProgressSlot>(std::move(label));
+    std::lock_guard lock{mutex_};
+    added_.push_back(slot);
+    return slot;
+  }
+
+  ProgressRenderer(const ProgressRenderer&) = delete;
+
+  ProgressRenderer& operator=(const ProgressRenderer&) = delete;
+
+  // draws a last frame
+  ~ProgressRenderer() noexcept {
+    {
+      std::lock_guard lock{mutex_};
+      stopped_ = true;
+    }
+    stop_signal_.notify_all();
+    thread_.join();
+  }
+};
+
+};  // namespace swish
+
+#endif
@@ -37,6 +37,14 @@ namespace swish {
 struct ProxyCredentials {
   std::string username{};
   std::string password{};
+
+  bool operator==(const ProxyCredentials& other) const {
+    return username == other.username && password == other.password;
+  }
+
+  bool operator!=(const ProxyCredentials& other) const {
+    return !(*this == other);
+  }
 };
 
 enum class ProxyProtocol {
@@ -97,7 +105,7 @@ struct Proxy {
     if (!IsOK(status)) return status;
 
     status = static_cast<StatusCode>(curl_easy_setopt(
-        curl_handle, CURLOPT_PROXYHEADER, header.header_data_.get()));
+        curl_handle, CURLOPT_PROXYHEADER, header.slist()));
 
     if (!IsOK(status)) return status;
 
@@ -30,12 +30,23 @@
 #include <curl/curl.h>
 
 #include <algorithm>
+#include <cstddef>
 #include <forward_list>
 #include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus > 201703L && __has_include(<span>)
+#include <span>
+#endif
 
 #include "client.h"
+#include "status_codes.h"
 
 namespace swish {
 template <typename CharT = char, typename CharTraits = std::char_traits<CharT>,
@@ -50,31 +61,51 @@ using BasicFormData =
 
 typedef BasicFormData<char> FormData;
 
-namespace {
+// ranges of key/value pairs, e.g. FormData. Strings are request bodies
+template <typename T, typename = void>
+struct is_form_data : std::false_type {};
+
+template <typename T>
+struct is_form_data<
+    T, std::void_t<decltype(std::declval<const T&>().size()),
+                   decltype(std::declval<const T&>().begin()->first),
+                   decltype(std::declval<const T&>().begin()->second)>>
+    : std::true_type {};
+
 /**
- * @brief constructs curl style header from std::map
+ * @brief joins form data fields into an application/x-www-form-urlencoded
+ * body, i.e. key=value&key=value
  *
- * [header] map to construct slist from
+ * [post_fields] non-empty form fields to join
  */
-
-template <typename MapT>
-
-inline curl_slist* ConstructRequestHeaderSList(const MapT& header) {
-  curl_slist* handle = nullptr;
-
-  for (const auto& field : header) {
-    handle =
-        curl_slist_append(handle, (field.first + ": " + field.second).c_str());
+template <typename FormDataT>
+inline std::string JoinFormData(const FormDataT& post_fields) {
+  std::string post_data{};
+
+  for (const auto& [key, value] : post_fields) {
+    if (!post_data.empty()) post_data.append("&");
+    post_data.append(key);
+    post_data.append("=");
+    post_data.append(value);
   }
 
-  return handle;
+  return post_data;
 }
-};  // namespace
-
-struct CurlSListDeleter {
-  inline void operator()(curl_slist* to_free) { curl_slist_free_all(to_free); }
-};
 
+/**
+ * @brief Request header fields stored in a single contiguous arena.
+ *
+ * Every field is kept as "Key: Value" followed by a terminator in one byte
+ * string, indexed by a small vector sorted by key. Keys are compared
+ * case-insensitively and looked up with string_views. Replacing or removing
+ * a field leaves its bytes behind until they outweigh the live ones, the
+ * arena is then compacted.
+ *
+ * The curl_slist handed to libcurl is an immutable snapshot of the fields,
+ * made of nodes pointing into its own copy of their bytes. It is only
+ * rebuilt when the fields changed, a transfer still holding the previous one
+ * through shared_slist() keeps it alive.
+ */
 template <typename ByteType = char,
           typename ByteTraits = std::char_traits<ByteType>,
           typename Allocator = std::allocator<ByteType>>
@@ -83,77 +114,254 @@ class BasicRequestHeader {
   using byte_type = ByteType;
   using allocator_type = Allocator;
   using byte_traits = ByteTraits;
-  using size_type = typename allocator_type::size_type;
-  using pointer = typename allocator_type::pointer;
+  using size_type = typename std::allocator_traits<allocator_type>::size_type;
+  using pointer = typename std::allocator_traits<allocator_type>::pointer;
   using string_type = std::basic_string<byte_type, byte_traits, allocator_type>;
+  using string_view_type = std::basic_string_view<byte_type, byte_traits>;
 
  private:
-  std::unique_ptr<curl_slist, CurlSListDeleter> header_data_{nullptr};
+  struct Field {
+    size_type offset;
+    size_type key_size;
+    size_type value_size;
+  };
+
+  string_type bytes_{};
+  std::vector<Field> fields_{};
+  // bytes of replaced and removed fields still in the arena
+  size_type dead_bytes_ = 0;
+
+  // fields as they were when the snapshot was taken, its nodes point into
+  // its bytes
+  struct SList {
+    string_type bytes{};
+    std::vector<curl_slist> nodes{};
+  };
+
+  // null while outdated
+  std::shared_ptr<SList> slist_{};
 
-  std::map<string_type, string_type, std::less<string_type>,
-           std::allocator<std::pair<const string_type, string_type>>>
-      header_view{};
+  static byte_type Lower(byte_type c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<byte_type>(c - 'A' + 'a') : c;
+  }
+
+  static bool KeyLess(string_view_type a, string_view_type b) {
+    return std::lexicographical_compare(
+        a.begin(), a.end(), b.begin(), b.end(),
+        [](byte_type x, byte_type y) { return Lower(x) < Lower(y); });
+  }
+
+  static bool KeyEqual(string_view_type a, string_view_type b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](byte_type x,
+                                                        byte_type y) {
+             return Lower(x) == Lower(y);
+           });
+  }
+
+  string_view_type Key(const Field& field) const {
+    return {bytes_.data() + field.offset, field.key_size};
+  }
+
+  string_view_type Value(const Field& field) const {
+    return {bytes_.data() + field.offset + field.key_size + 2,
+            field.value_size};
+  }
+
+  bool Overlaps(string_view_type bytes) const {
+    return !bytes.empty() && bytes.data() >= bytes_.data() &&
+           bytes.data() < bytes_.data() + bytes_.size();
+  }
+
+  static size_type StoredSize(const Field& field) {
+    // separator and terminator
+    return field.key_size + field.value_size + 3;
+  }
+
+  typename std::vector<Field>::iterator Find(string_view_type key) {
+    return std::lower_bound(fields_.begin(), fields_.end(), key,
+                            [this](const Field& field, string_view_type k) {
+                              return KeyLess(Key(field), k);
+                            });
+  }
+
+  bool Matches(typename std::vector<Field>::iterator field,
+               string_view_type key) const {
+    return field != fields_.end() && KeyEqual(Key(*field), key);
+  }
+
+  // moves the live fields to the front of the arena in place, in order of
+  // their offsets, a header only has a few fields
+  void Compact() {
+    size_type compacted = 0;
+    size_type next_offset = 0;
+
+    for (size_type moved = 0; moved < fields_.size(); moved++) {
+      Field* next = nullptr;
+      for (Field& field : fields_) {
+        if (field.offset >= next_offset &&
+            (next == nullptr || field.offset < next->offset))
+          next = &field;
+      }
+
+      size_type size = StoredSize(*next);
+      next_offset = next->offset + size;
+
+      byte_traits::move(bytes_.data() + compacted, bytes_.data() + next->offset,
+                        size);
+      next->offset = compacted;
+      compacted += size;
+    }
+
+    bytes_.resize(compacted);
+    dead_bytes_ = 0;
+  }
+
+  void BuildSList() {
+    auto slist = std::make_shared<SList>();
+    slist->bytes.reserve(bytes_.size() - dead_bytes_);
+    for (const Field& field : fields_)
+      slist->bytes.append(bytes_.data() + field.offset, StoredSize(field));
+
+    slist->nodes.resize(fields_.size());
+
+    size_type offset = 0;
+    for (size_type i = 0; i < fields_.size(); i++) {
+      // libcurl only reads the nodes
+      slist->nodes[i].data =
+          reinterpret_cast<char*>(slist->bytes.data() + offset);
+      slist->nodes[i].next =
+          i + 1 < fields_.size() ? &slist->nodes[i + 1] : nullptr;
+      offset += StoredSize(fields_[i]);
+    }
+
+    slist_ = std::move(slist);
+  }
 
  public:
   static constexpr const byte_type field_seperator[] = ": ";
 
   BasicRequestHeader() = default;
 
-  // not allowed, type curl_slist* indeterminate
-  BasicRequestHeader(const BasicRequestHeader& h) {
-    header_view = h.header_view;
-    header_data_.reset(ConstructRequestHeaderSList(header_view));
-  };
+  // the snapshot is immutable, copies share it
+  BasicRequestHeader(const BasicRequestHeader& other) = default;
 
-  BasicRequestHeader(BasicRequestHeader&& header) = default;
+  BasicRequestHeader(BasicRequestHeader&& other)
+      : bytes_{std::move(other.bytes_)},
+        fields_{std::move(other.fields_)},
+        dead_bytes_{other.dead_bytes_},
+        slist_{std::move(other.slist_)} {
+    other.Clear();
+  }
 
-  BasicRequestHeader& operator=(const BasicRequestHeader& h) {
-    header_view = h.header_view;
-    header_data_.reset(ConstructRequestHeaderSList(header_view));
+  BasicRequestHeader& operator=(const BasicRequestHeader& other) = default;
+
+  BasicRequestHeader& operator=(BasicRequestHeader&& other) {
+    bytes_ = std::move(other.bytes_);
+    fields_ = std::move(other.fields_);
+    dead_bytes_ = other.dead_bytes_;
+    slist_ = std::move(other.slist_);
+    other.Clear();
     return *this;
-  };
+  }
+
+  /**
+   * @brief sets the [key] field to [value], replacing any previous value
+   *
+   */
+  inline void Emplace(string_view_type key, string_view_type value) {
+    // views of this header's own fields would not survive the arena growing
+    if (Overlaps(key) || Overlaps(value)) {
+      string_type key_copy{key}, value_copy{value};
+      Emplace(key_copy, value_copy);
+      return;
+    }
+
+    auto field = Find(key);
+
+    Field added{bytes_.size(), key.size(), value.size()};
+    bytes_.append(key.data(), key.size());
+    bytes_.append(field_seperator);
+    bytes_.append(value.data(), value.size());
+    bytes_.push_back(byte_type{});
+
+    if (Matches(field, key)) {
+      dead_bytes_ += StoredSize(*field);
+      *field = added;
+    } else {
+      fields_.insert(field, added);
+    }
+
+    if (dead_bytes_ > bytes_.size() / 2) Compact();
+    slist_.reset();
+  }
 
-  BasicRequestHeader& operator=(BasicRequestHeader&&) = default;
+  // range checked
+  inline string_view_type operator[](string_view_type key) const {
+    auto field = const_cast<BasicRequestHeader*>(this)->Find(key);
+    if (field == fields_.end() || !KeyEqual(Key(*field), key))
+      throw std::out_of_range{"Request header field not found"};
 
-  inline void Emplace(std::string_view key, std::string_view value) {
-    auto new_handle = curl_slist_append(
-        header_data_.get(),
-        string_type{key.data()}.append(field_seperator).append(value).c_str());
+    return Value(*field);
+  }
+
+  // true if a [key] field is set
+  inline bool Contains(string_view_type key) const {
+    auto field = const_cast<BasicRequestHeader*>(this)->Find(key);
+    return field != fields_.end() && KeyEqual(Key(*field), key);
+  }
 
-    header_view.emplace(key, value);
+  inline void Pop(string_view_type key) {
+    auto field = Find(key);
+    if (!Matches(field, key)) return;
 
-    if (new_handle == nullptr)
-      throw std::runtime_error{
-          "Unable to append header data, CURL SLIST APPEND error occured"};
+    dead_bytes_ += StoredSize(*field);
+    fields_.erase(field);
 
-    header_data_.release();
-    header_data_.reset(new_handle);
+    if (fields_.empty()) {
+      Clear();
+      return;
+    }
+
+    if (dead_bytes_ > bytes_.size() / 2) Compact();
+    slist_.reset();
   }
 
-  // range checked
-  inline const string_type& operator[](const std::string& key) {
-    return header_view.at(key);
+  // removes every field, keeping the arena's memory
+  inline void Clear() {
+    bytes_.clear();
+    fields_.clear();
+    dead_bytes_ = 0;
+    slist_.reset();
   }
 
-  // costly
-  inline void Pop(const string_type& key) {
-    Clear();
-    header_view.erase(key);
-    // deletes previous data, and recreates a new one
+  inline bool Empty() const { return fields_.empty(); }
 
-    header_data_.reset(ConstructRequestHeaderSList(header_view));
-  }
+  inline size_type size() const { return fields_.size(); }
 
-  //  resets to nullptr
-  inline void Clear() { header_data_.reset(); }
+  /**
+   * @brief fields as a curl_slist to hand to libcurl, nullptr if there are
+   * none. Valid until the fields change, unless held by shared_slist().
+   *
+   */
+  curl_slist* slist() {
+    if (fields_.empty()) return nullptr;
+    if (slist_ == nullptr) BuildSList();
+    return slist_->nodes.data();
+  }
 
-  inline bool Empty() const { return header_view.empty(); }
+  /**
+   * @brief the same curl_slist as slist(), kept alive for as long as the
+   * returned pointer is held even if the fields change meanwhile
+   *
+   */
+  std::shared_ptr<curl_slist> shared_slist() {
+    curl_slist* list = slist();
+    if (list == nullptr) return nullptr;
+    return std::shared_ptr<curl_slist>{slist_, list};
+  }
 
-  // destructor slist free already specified
   ~BasicRequestHeader() = default;
-
-  friend class Configuration;
-  friend class Proxy;
 };
 
 namespace hackery {
@@ -240,6 +448,77 @@ class MultipartFormData {
 
 };  // namespace hackery
 
+/**
+ * @brief Contiguous request body handed to libcurl as is, without being
+ * copied or read through a callback.
+ *
+ * A body viewing memory it does not own requires that memory to outlive the
+ * transfer, one made from a ref-counted buffer keeps the buffer alive for as
+ * long as the body or any of its copies exist.
+ */
+class RequestBody {
+  std::shared_ptr<const void> owner_{};
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+
+ public:
+  RequestBody() = default;
+
+  RequestBody(std::string_view data) : data_{data.data()}, size_{data.size()} {}
+
+  RequestBody(const char* data) : RequestBody{std::string_view{data}} {}
+
+  template <typename ByteType, typename ByteTraits, typename Allocator>
+  RequestBody(const std::basic_string<ByteType, ByteTraits, Allocator>& data)
+      : data_{reinterpret_cast<const char*>(data.data())},
+        size_{data.size() * sizeof(ByteType)} {}
+
+  // the string would be destroyed before the transfer, share it instead
+  template <typename ByteType, typename ByteTraits, typename Allocator>
+  RequestBody(std::basic_string<ByteType, ByteTraits, Allocator>&&) = delete;
+
+#if defined(__cpp_lib_span)
+  RequestBody(std::span<const std::byte> data)
+      : data_{reinterpret_cast<const char*>(data.data())},
+        size_{data.size()} {}
+#endif
+
+  /**
+   * @brief shares ownership of [buffer], a contiguous container with data()
+   * and size() members such as std::string or std::vector
+   *
+   */
+  template <typename Buffer>
+  RequestBody(std::shared_ptr<Buffer> buffer)
+      : data_{reinterpret_cast<const char*>(buffer->data())},
+        size_{buffer->size() * sizeof(*buffer->data())} {
+    owner_ = std::move(buffer);
+  }
+
+  // [size] bytes at [data], kept alive by [owner]
+  RequestBody(std::shared_ptr<const void> owner, const void* data, size_t size)
+      : owner_{std::move(owner)},
+        data_{static_cast<const char*>(data)},
+        size_{size} {}
+
+  const char* data() const { return data_; }
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  // posts the body with [handle], libcurl reads it in place
+  StatusCode ConfigHandle(CURL* handle) const {
+    StatusCode status = static_cast<StatusCode>(curl_easy_setopt(
+        handle, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(size_)));
+    if (!IsOK(status)) return status;
+
+    // an empty body is still sent as one, not read from a callback
+    return static_cast<StatusCode>(curl_easy_setopt(
+        handle, CURLOPT_POSTFIELDS, data_ == nullptr ? "" : data_));
+  }
+};
+
 typedef BasicRequestHeader<char> RequestHeader;
 };  // namespace swish
 #endif
\ No newline at end of file
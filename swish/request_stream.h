@@ -0,0 +1,281 @@
+#ifndef ______lib_SWISH___request_stream_h
+#define ______lib_SWISH___request_stream_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <curl/curl.h>
+
+#include "status_codes.h"
+
+namespace swish {
+
+/**
+ * @brief Request body produced while it is being uploaded.
+ *
+ * A producer thread pushes blocks into a queue bounded to [capacity] bytes,
+ * blocking while it is full, and closes the stream once the body is complete.
+ * The transfer drains the queue from its read callback and is paused while
+ * the queue is empty, the producer wakes the thread driving it up as soon as
+ * more data is pushed. The body has no known size, so it is sent with
+ * Transfer-Encoding: chunked over HTTP/1.1.
+ *
+ * A stream is used for a single transfer, and must outlive it.
+ */
+class RequestStream {
+  mutable std::mutex mutex_{};
+  std::condition_variable writable_{};
+
+  std::deque<std::string> blocks_{};
+  // bytes of the front block already sent
+  size_t front_offset_ = 0;
+  size_t buffered_ = 0;
+  size_t capacity_ = 0;
+
+  bool closed_ = false;
+  bool aborted_ = false;
+  bool finished_ = false;
+
+  // the read callback paused the transfer on an empty queue
+  bool paused_ = false;
+  // multi handle driving the transfer, woken up when data is pushed
+  CURLM* multi_handle_ = nullptr;
+
+  // wakes the transfer up if it waits for data, [mutex_] must be held
+  void Notify() {
+    if (paused_ && multi_handle_ != nullptr) curl_multi_wakeup(multi_handle_);
+  }
+
+  // the transfer is driven through [multi_handle] from now on
+  void Attach(CURLM* multi_handle) {
+    std::lock_guard lock{mutex_};
+    multi_handle_ = multi_handle;
+  }
+
+  // the transfer is done, producers blocked on a full queue give up
+  void Detach() {
+    {
+      std::lock_guard lock{mutex_};
+      multi_handle_ = nullptr;
+      finished_ = true;
+      blocks_.clear();
+      buffered_ = 0;
+    }
+    writable_.notify_all();
+  }
+
+  // true if the paused transfer has data to send again, it must be unpaused
+  bool Resume() {
+    std::lock_guard lock{mutex_};
+    if (!paused_ || (buffered_ == 0 && !closed_ && !aborted_)) return false;
+
+    paused_ = false;
+    return true;
+  }
+
+  // whether the read callback paused the transfer and it was not resumed yet
+  bool paused() const {
+    std::lock_guard lock{mutex_};
+    return paused_;
+  }
+
+  // unpauses the transfer of [handle] if data arrived while it was paused,
+  // left paused while it is [throttled] by its bandwidth governor, which
+  // resumes it in turn
+  void ResumeTransfer(CURL* handle, bool throttled = false) {
+    if (Resume() && !throttled) curl_easy_pause(handle, CURLPAUSE_CONT);
+  }
+
+  // performs the transfer of [handle] on this thread, like curl_easy_perform
+  StatusCode Perform(CURL* handle) {
+    CURLM* multi_handle = curl_multi_init();
+    if (multi_handle == nullptr) return StatusCode::InitializationError;
+
+    if (curl_multi_add_handle(multi_handle, handle) != CURLM_OK) {
+      curl_multi_cleanup(multi_handle);
+      return StatusCode::InitializationError;
+    }
+
+    Attach(multi_handle);
+
+    int running = 1;
+    while (running > 0) {
+      ResumeTransfer(handle);
+      curl_multi_perform(multi_handle, &running);
+      if (running > 0)
+        curl_multi_poll(multi_handle, nullptr, 0, 1000, nullptr);
+    }
+
+    StatusCode status = StatusCode::OK;
+
+    CURLMsg* message = nullptr;
+    int queued = 0;
+    while ((message = curl_multi_info_read(multi_handle, &queued)) != nullptr) {
+      if (message->msg == CURLMSG_DONE)
+        status = static_cast<StatusCode>(message->data.result);
+    }
+
+    Detach();
+
+    curl_multi_remove_handle(multi_handle, handle);
+    curl_multi_cleanup(multi_handle);
+
+    return status;
+  }
+
+ public:
+  static constexpr size_t default_capacity = 1024 * 1024;
+
+  explicit RequestStream(size_t capacity = default_capacity)
+      : capacity_{capacity} {}
+
+  /**
+   * @brief queues [block] for upload, waiting while the queue holds
+   * [capacity] bytes or more. A block larger than the capacity is queued once
+   * the queue is empty.
+   *
+   * returns false if the stream was closed or the transfer has ended, the
+   * block is then dropped
+   */
+  bool Push(std::string block) {
+    std::unique_lock lock{mutex_};
+    writable_.wait(lock, [&] {
+      return finished_ || closed_ || aborted_ || buffered_ == 0 ||
+             buffered_ + block.size() <= capacity_;
+    });
+
+    if (finished_ || closed_ || aborted_) return false;
+    // an empty block would read as the end of the body
+    if (block.empty()) return true;
+
+    buffered_ += block.size();
+    blocks_.push_back(std::move(block));
+    Notify();
+    return true;
+  }
+
+  bool Push(std::string_view block) { return Push(std::string{block}); }
+
+  bool Push(const char* block) { return Push(std::string{block}); }
+
+  /**
+   * @brief ends the body once the queued blocks are sent
+   *
+   */
+  void Close() {
+    std::lock_guard lock{mutex_};
+    closed_ = true;
+    Notify();
+  }
+
+  /**
+   * @brief fails the transfer, it returns StatusCode::CallbackAborted
+   *
+   */
+  void Abort() {
+    {
+      std::lock_guard lock{mutex_};
+      aborted_ = true;
+      Notify();
+    }
+    writable_.notify_all();
+  }
+
+  // bytes queued and not yet sent
+  size_t buffered() const {
+    std::lock_guard lock{mutex_};
+    return buffered_;
+  }
+
+  size_t capacity() const { return capacity_; }
+
+  /**
+   * @brief libcurl read callback with a RequestStream as its data, copies
+   * queued blocks into [destination] or pauses the transfer until some are
+   * pushed
+   *
+   */
+  static size_t ReadCallback(char* destination, size_t size, size_t count,
+                             void* data) {
+    RequestStream* stream = static_cast<RequestStream*>(data);
+    size_t capacity = size * count;
+    size_t copied = 0;
+
+    {
+      std::lock_guard lock{stream->mutex_};
+
+      if (stream->aborted_) return CURL_READFUNC_ABORT;
+
+      if (stream->blocks_.empty()) {
+        if (stream->closed_) return 0;
+
+        stream->paused_ = true;
+        return CURL_READFUNC_PAUSE;
+      }
+
+      while (copied < capacity && !stream->blocks_.empty()) {
+        const std::string& block = stream->blocks_.front();
+        size_t length =
+            std::min(capacity - copied, block.size() - stream->front_offset_);
+
+        std::memcpy(destination + copied, block.data() + stream->front_offset_,
+                    length);
+        copied += length;
+        stream->front_offset_ += length;
+
+        if (stream->front_offset_ == block.size()) {
+          stream->blocks_.pop_front();
+          stream->front_offset_ = 0;
+        }
+      }
+
+      stream->buffered_ -= copied;
+    }
+
+    stream->writable_.notify_all();
+    return copied;
+  }
+
+  RequestStream(const RequestStream&) = delete;
+
+  RequestStream& operator=(const RequestStream&) = delete;
+
+  friend class Client;
+
+  template <typename, typename, typename>
+  friend class BasicMultiClient;
+};
+
+};  // namespace swish
+
+#endif
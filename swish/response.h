@@ -32,9 +32,122 @@
 
 #include "http.h"
 #include "io_buffers.h"
+#include "response_header.h"
 #include "status_codes.h"
 namespace swish {
 
+template <typename RxByteType, typename RxByteTraits, typename RxAllocator>
+class BasicMultiClient;
+
+template <typename RxByteType, typename RxByteTraits, typename RxAllocator>
+class BasicAsyncClient;
+
+template <typename RxByteType, typename RxByteTraits, typename RxAllocator>
+class BasicPreparedRequest;
+
+/**
+ * @brief Time spent in each phase of a transfer.
+ *
+ * Like the libcurl values they are read from, every point is measured from
+ * the start of the transfer, including any redirects followed. The phase
+ * durations are derived from consecutive points.
+ */
+struct Timings {
+  // CURLINFO_NAMELOOKUP_TIME_T, host name resolved
+  std::chrono::microseconds name_lookup{};
+
+  // CURLINFO_CONNECT_TIME_T, TCP connection to the host or proxy established
+  std::chrono::microseconds connect{};
+
+  // CURLINFO_APPCONNECT_TIME_T, TLS handshake done, zero without TLS
+  std::chrono::microseconds app_connect{};
+
+  // CURLINFO_PRETRANSFER_TIME_T, request about to be sent
+  std::chrono::microseconds pre_transfer{};
+
+  // CURLINFO_STARTTRANSFER_TIME_T, first response byte received
+  std::chrono::microseconds start_transfer{};
+
+  // CURLINFO_TOTAL_TIME_T, transfer completed
+  std::chrono::microseconds total{};
+
+  // CURLINFO_REDIRECT_TIME_T, spent on redirects before the final request
+  std::chrono::microseconds redirect{};
+
+  std::chrono::microseconds dns() const { return name_lookup; }
+
+  std::chrono::microseconds tcp_handshake() const {
+    return Between(name_lookup, connect);
+  }
+
+  std::chrono::microseconds tls_handshake() const {
+    return app_connect.count() == 0 ? std::chrono::microseconds{}
+                                    : Between(connect, app_connect);
+  }
+
+  // time to first byte once the request was sent, i.e. server think time
+  std::chrono::microseconds server_processing() const {
+    return Between(pre_transfer, start_transfer);
+  }
+
+  std::chrono::microseconds content_transfer() const {
+    return Between(start_transfer, total);
+  }
+
+  // reads the timings of the last transfer of [curl_handle]
+  void Read(CURL* curl_handle) {
+    name_lookup = Get(curl_handle, CURLINFO_NAMELOOKUP_TIME_T);
+    connect = Get(curl_handle, CURLINFO_CONNECT_TIME_T);
+    app_connect = Get(curl_handle, CURLINFO_APPCONNECT_TIME_T);
+    pre_transfer = Get(curl_handle, CURLINFO_PRETRANSFER_TIME_T);
+    start_transfer = Get(curl_handle, CURLINFO_STARTTRANSFER_TIME_T);
+    total = Get(curl_handle, CURLINFO_TOTAL_TIME_T);
+    redirect = Get(curl_handle, CURLINFO_REDIRECT_TIME_T);
+  }
+
+ private:
+  // a reused connection reports zero for the phases it skipped
+  static std::chrono::microseconds Between(std::chrono::microseconds start,
+                                           std::chrono::microseconds end) {
+    return end > start ? end - start : std::chrono::microseconds{};
+  }
+
+  static std::chrono::microseconds Get(CURL* curl_handle, CURLINFO info) {
+    curl_off_t value = 0;
+    if (curl_easy_getinfo(curl_handle, info, &value) != CURLE_OK) value = 0;
+    return std::chrono::microseconds{value};
+  }
+};
+
+/**
+ * @brief metadata a Response reads from its handle once the transfer is done,
+ * combined as Configuration::response_fields. The body and headers are always
+ * kept.
+ */
+enum ResponseField : uint32_t {
+  kResponseCode = 1 << 0,
+  kHttpVersion = 1 << 1,
+  kTimings = 1 << 2,
+  kRedirectUrl = 1 << 3,
+  kContentType = 1 << 4,
+  kBytesUploaded = 1 << 5,
+  kDownloadSpeed = 1 << 6,
+  kHeaderSize = 1 << 7,
+  kConnectCode = 1 << 8,
+  kRedirectCount = 1 << 9,
+
+  kAllResponseFields = (1 << 10) - 1
+};
+
+// transfer rates smoothed while the transfer went on, in bytes per second
+struct Throughput {
+  double download_rate = 0;
+  double upload_rate = 0;
+
+  // the download was aborted by the stall policy
+  bool stalled = false;
+};
+
 // memory allocated by curl is freed by curl_free
 
 // fields to be filled must be known at compile time
@@ -44,40 +157,48 @@ struct Response {
   //  CURLOPT_MAXREDIRS
   // char* //  curl_easy_getinfo(curl, CURLINFO_REDIRECT_URL, &url);
  private:
-  int64_t total_duration_{};
-  int64_t connection_delay_{};
-  int64_t redirect_duration_{};
+  Timings timings_{};
+  Throughput throughput_{};
   int64_t response_code_{0};
   int64_t http_version_{static_cast<int64_t>(http::Version_None)};
 
-  // ASSUMED freed by curl_easy_free
-  char* redirect_url_ = nullptr;
+  // copied out of the handle, which the next request on it overwrites
+  std::string redirect_url_{};
 
-  char* content_type_ = nullptr;
+  std::string content_type_{};
 
  public:
   using response_body_buffer_type = ResponseBodyBuffer_t;
 
   friend class Client;
 
-  // CURLINFO_TOTAL_TIME_T
+  template <typename, typename, typename>
+  friend class BasicMultiClient;
+
+  template <typename, typename, typename>
+  friend class BasicAsyncClient;
+
+  template <typename, typename, typename>
+  friend class BasicPreparedRequest;
 
-  std::chrono::microseconds total_duration() {
-    return std::chrono::milliseconds(total_duration_);
-  };
-  // res = curl_easy_getinfo(curl_handle, CURLINFO_CONNECT_TIME_T, &val);
-  // if((CURLE_OK == res) && (val>0))
-  std::chrono::microseconds connection_delay() {
-    return std::chrono::milliseconds(connection_delay_);
-  };
+  // phase breakdown of the transfer
+  const Timings& timings() const { return timings_; }
 
-  //  res = curl_easy_getinfo(curl, CURLINFO_REDIRECT_TIME_T, &redirect);
-  // double seconds -> redirect
-  std::chrono::microseconds redirect_duration() {
-    return std::chrono::microseconds(redirect_duration_);
-  };
+  // smoothed rates of the transfer, only measured with
+  // Configuration::track_throughput or a stall policy
+  const Throughput& throughput() const { return throughput_; }
 
-  std::string_view redirect_url() { return redirect_url_; };
+  std::chrono::microseconds total_duration() const { return timings_.total; }
+
+  std::chrono::microseconds connection_delay() const {
+    return timings_.connect;
+  }
+
+  std::chrono::microseconds redirect_duration() const {
+    return timings_.redirect;
+  }
+
+  std::string_view redirect_url() const { return redirect_url_; };
 
   // curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
   http::ResponseCode response_code() {
@@ -95,7 +216,7 @@ struct Response {
   size_t average_download_speed = 0;
 
   // res = curl_easy_getinfo(curl, CURLINFO_CONTENT_TYPE, &ct);  
-  std::string_view content_type() { return content_type_; };
+  std::string_view content_type() const { return content_type_; };
 
   // curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &size);
   size_t header_size = 0;
@@ -117,43 +238,49 @@ struct Response {
 
  private:
   /**
- * @brief  void Prepare(CURL* curl_handle , _,
-  //            response_body_buffer_type&& body_data_)
-*/
+   * @brief reads the [fields] of the transfer done on [curl_handle], a
+   * combination of ResponseField flags, and takes the received data over
+   *
+   */
   void Prepare(CURL* curl_handle, response_body_buffer_type&& body_data,
-               ResponseHeaderBuffer&& header_data) {
-    //
-    curl_easy_getinfo(curl_handle, CURLINFO_TOTAL_TIME_T, &total_duration_);
-
-    curl_easy_getinfo(curl_handle, CURLINFO_CONNECT_TIME_T, &connection_delay_);
-
-    curl_easy_getinfo(curl_handle, CURLINFO_REDIRECT_TIME_T,
-                      &redirect_duration_);
-
-    curl_easy_getinfo(curl_handle, CURLINFO_REDIRECT_URL, &redirect_url_);
+               ResponseHeaderBuffer&& header_data,
+               uint32_t fields = kAllResponseFields) {
+    if (fields & kTimings) timings_.Read(curl_handle);
 
-    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &response_code_);
+    if (fields & kRedirectUrl) {
+      char* redirect_url = nullptr;
+      curl_easy_getinfo(curl_handle, CURLINFO_REDIRECT_URL, &redirect_url);
+      if (redirect_url != nullptr) redirect_url_ = redirect_url;
+    }
 
-    curl_easy_getinfo(curl_handle, CURLINFO_HTTP_VERSION, &http_version_);
+    if (fields & kResponseCode)
+      curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &response_code_);
 
-    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_UPLOAD_T, &bytes_uploaded);
+    if (fields & kHttpVersion)
+      curl_easy_getinfo(curl_handle, CURLINFO_HTTP_VERSION, &http_version_);
 
-    curl_easy_getinfo(curl_handle, CURLINFO_SPEED_DOWNLOAD_T,
-                      &average_download_speed);
+    if (fields & kBytesUploaded)
+      curl_easy_getinfo(curl_handle, CURLINFO_SIZE_UPLOAD_T, &bytes_uploaded);
 
-    curl_easy_getinfo(curl_handle, CURLINFO_CONTENT_TYPE, &content_type_);
+    if (fields & kDownloadSpeed)
+      curl_easy_getinfo(curl_handle, CURLINFO_SPEED_DOWNLOAD_T,
+                        &average_download_speed);
 
-    curl_easy_getinfo(curl_handle, CURLINFO_HEADER_SIZE, &header_size);
+    // the Content-Type of the final response, as CURLINFO_CONTENT_TYPE
+    std::string_view content_type{};
+    if ((fields & kContentType) &&
+        header_data.Find("Content-Type", &content_type))
+      content_type_ = content_type;
 
+    if (fields & kHeaderSize)
+      curl_easy_getinfo(curl_handle, CURLINFO_HEADER_SIZE, &header_size);
 
-  curl_easy_getinfo(curl_handle, CURLINFO_HTTP_CONNECTCODE, &connect_code);
+    if (fields & kConnectCode)
+      curl_easy_getinfo(curl_handle, CURLINFO_HTTP_CONNECTCODE, &connect_code);
 
-    curl_easy_getinfo(curl_handle, CURLINFO_REDIRECT_COUNT, &redirect_count);
+    if (fields & kRedirectCount)
+      curl_easy_getinfo(curl_handle, CURLINFO_REDIRECT_COUNT, &redirect_count);
 
-    /**
-     * @brief
-     *
-     */
     header = std::move(header_data);
     body = std::move(body_data);
   }
@@ -0,0 +1,475 @@
+#ifndef ______lib_SWISH___response_header_h
+#define ______lib_SWISH___response_header_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SWISH_HAS_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace swish {
+
+namespace {
+
+inline unsigned LowestSetBit(unsigned mask) {
+#if defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanForward(&index, mask);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+constexpr size_t no_colon = static_cast<size_t>(-1);
+
+/**
+ * @brief returns the position of the first line feed in [data], [size] if
+ * there is none, and sets [colon] to the first colon before it unless one was
+ * already found. Compares 16 bytes at a time when SSE2 is available.
+ *
+ */
+inline size_t ScanHeaderLine(const char* data, size_t size, size_t* colon) {
+  size_t i = 0;
+
+#if defined(SWISH_HAS_SSE2)
+  const __m128i line_feeds = _mm_set1_epi8('\n');
+  const __m128i colons = _mm_set1_epi8(':');
+
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    unsigned ends = static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, line_feeds)));
+
+    if (*colon == no_colon) {
+      unsigned separators = static_cast<unsigned>(
+          _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, colons)));
+      // colons past the end of the line belong to the next one
+      if (ends != 0) separators &= (1u << LowestSetBit(ends)) - 1;
+      if (separators != 0) *colon = i + LowestSetBit(separators);
+    }
+
+    if (ends != 0) return i + LowestSetBit(ends);
+  }
+#endif
+
+  for (; i < size; i++) {
+    if (data[i] == '\n') return i;
+    if (data[i] == ':' && *colon == no_colon) *colon = i;
+  }
+
+  return size;
+}
+
+};  // namespace
+
+/**
+ * @brief Response header lines parsed as they are received.
+ *
+ * Lines are appended to one contiguous arena as libcurl hands them over and
+ * split into name and value in the same pass, fields only record offsets into
+ * the arena. Every status line starts a new block, so the headers of
+ * redirects, 100 Continue and proxy CONNECT responses are kept apart from
+ * those of the final response. Names of the last block are indexed in an open
+ * addressing hash table: looking a field up is case-insensitive, takes a
+ * string_view and allocates nothing.
+ *
+ * ToString() still returns the headers as they were received.
+ */
+template <typename ByteType = char,
+          typename ByteTraits = std::char_traits<ByteType>,
+          typename Allocator = std::allocator<ByteType>>
+class BasicResponseHeader {
+ public:
+  using byte_type = ByteType;
+  using allocator_type = Allocator;
+  using byte_traits = ByteTraits;
+  using size_type = typename std::allocator_traits<allocator_type>::size_type;
+  using pointer = typename std::allocator_traits<allocator_type>::pointer;
+  using string_type = std::basic_string<byte_type, byte_traits, allocator_type>;
+  using string_view_type = std::basic_string_view<byte_type, byte_traits>;
+
+  struct Field {
+    string_view_type name{};
+    string_view_type value{};
+  };
+
+ private:
+  struct Entry {
+    size_type name_offset;
+    size_type name_size;
+    size_type value_offset;
+    size_type value_size;
+  };
+
+  struct Block {
+    size_type status_offset;
+    size_type status_size;
+    int status_code;
+    // index of the first field of the block in [fields_]
+    size_type first_field;
+  };
+
+  string_type bytes_{};
+  std::vector<Entry> fields_{};
+  std::vector<Block> blocks_{};
+
+  // slots hold the index of a field of the last block plus one, 0 if empty
+  std::vector<uint32_t> index_{};
+
+  // start of the line being received, and its colon once it was scanned
+  size_type line_start_ = 0;
+  size_type scanned_ = 0;
+  size_t colon_ = no_colon;
+
+  static constexpr size_type minimum_index_size = 32;
+
+  static byte_type Lower(byte_type c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<byte_type>(c - 'A' + 'a') : c;
+  }
+
+  static bool NameEqual(string_view_type a, string_view_type b) {
+    if (a.size() != b.size()) return false;
+
+    for (size_type i = 0; i < a.size(); i++) {
+      if (Lower(a[i]) != Lower(b[i])) return false;
+    }
+    return true;
+  }
+
+  // FNV-1a of the lowercased name
+  static uint32_t Hash(string_view_type name) {
+    uint32_t hash = 2166136261u;
+    for (byte_type c : name) {
+      hash ^= static_cast<uint32_t>(static_cast<unsigned char>(Lower(c)));
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+
+  static bool IsSpace(byte_type c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  static string_view_type Trim(string_view_type bytes) {
+    while (!bytes.empty() && IsSpace(bytes.front())) bytes.remove_prefix(1);
+    while (!bytes.empty() && IsSpace(bytes.back())) bytes.remove_suffix(1);
+    return bytes;
+  }
+
+  string_view_type Bytes(size_type offset, size_type size) const {
+    return {bytes_.data() + offset, size};
+  }
+
+  Field MakeField(const Entry& entry) const {
+    return {Bytes(entry.name_offset, entry.name_size),
+            Bytes(entry.value_offset, entry.value_size)};
+  }
+
+  size_type FieldCount(size_type block) const {
+    size_type end = block + 1 < blocks_.size() ? blocks_[block + 1].first_field
+                                               : fields_.size();
+    return end - blocks_[block].first_field;
+  }
+
+  // places field [field] of the last block, a later field of the same name
+  // takes the slot of an earlier one
+  void IndexField(size_type field) {
+    string_view_type name = MakeField(fields_[field]).name;
+    size_type mask = index_.size() - 1;
+
+    for (size_type slot = Hash(name) & mask;; slot = (slot + 1) & mask) {
+      uint32_t& entry = index_[slot];
+      if (entry == 0 || NameEqual(MakeField(fields_[entry - 1]).name, name)) {
+        entry = static_cast<uint32_t>(field + 1);
+        return;
+      }
+    }
+  }
+
+  // keeps the load factor of the index at most one half
+  void GrowIndex() {
+    size_type count = FieldCount(blocks_.size() - 1);
+    if (count * 2 <= index_.size()) return;
+
+    index_.assign(std::max(minimum_index_size, index_.size() * 2), 0);
+    for (size_type field = blocks_.back().first_field; field < fields_.size();
+         field++)
+      IndexField(field);
+  }
+
+  void StartBlock(size_type status_offset, size_type status_size) {
+    string_view_type status = Bytes(status_offset, status_size);
+    int status_code = 0;
+
+    // HTTP/1.1 200 OK
+    size_type code_start = status.find(' ');
+    if (code_start != string_view_type::npos) {
+      for (size_type i = code_start + 1;
+           i < status.size() && status[i] >= '0' && status[i] <= '9'; i++)
+        status_code = status_code * 10 + (status[i] - '0');
+    }
+
+    blocks_.push_back(Block{status_offset, status_size, status_code,
+                            static_cast<size_type>(fields_.size())});
+    std::fill(index_.begin(), index_.end(), 0);
+  }
+
+  void ParseLine(size_type start, size_type end, size_t colon) {
+    string_view_type line = Trim(Bytes(start, end - start));
+    if (line.empty()) return;
+
+    constexpr byte_type status_prefix[] = {'H', 'T', 'T', 'P', '/'};
+    if (line.size() >= 5 &&
+        byte_traits::compare(line.data(), status_prefix, 5) == 0) {
+      StartBlock(static_cast<size_type>(line.data() - bytes_.data()),
+                 line.size());
+      return;
+    }
+
+    // folded continuation lines are obsolete and not parsed
+    if (colon == no_colon || IsSpace(bytes_[start])) return;
+
+    // fields received before any status line form a block of their own
+    if (blocks_.empty()) StartBlock(start, 0);
+
+    string_view_type name = Trim(Bytes(start, colon - start));
+    string_view_type value = Trim(Bytes(colon + 1, end - colon - 1));
+    if (name.empty()) return;
+
+    fields_.push_back(
+        Entry{static_cast<size_type>(name.data() - bytes_.data()), name.size(),
+              static_cast<size_type>(value.data() - bytes_.data()),
+              value.size()});
+
+    GrowIndex();
+    IndexField(fields_.size() - 1);
+  }
+
+  // splits the received bytes from [scanned_] on into lines, a line without
+  // its line feed yet is finished by the next push
+  void Parse() {
+    while (scanned_ < bytes_.size()) {
+      size_type size = bytes_.size() - scanned_;
+      // any other value skips the search for a colon already found
+      size_t colon = colon_ == no_colon ? no_colon : 0;
+      size_type end;
+
+      if constexpr (sizeof(byte_type) == 1) {
+        end = ScanHeaderLine(
+            reinterpret_cast<const char*>(bytes_.data() + scanned_), size,
+            &colon);
+      } else {
+        for (end = 0; end < size && bytes_[scanned_ + end] != '\n'; end++) {
+          if (bytes_[scanned_ + end] == ':' && colon == no_colon) colon = end;
+        }
+      }
+
+      if (colon_ == no_colon && colon != no_colon) colon_ = scanned_ + colon;
+
+      if (end == size) {
+        scanned_ = bytes_.size();
+        return;
+      }
+
+      scanned_ += end + 1;
+      ParseLine(line_start_, scanned_, colon_);
+      line_start_ = scanned_;
+      colon_ = no_colon;
+    }
+  }
+
+ public:
+  BasicResponseHeader() = default;
+
+  BasicResponseHeader(const BasicResponseHeader&) = default;
+
+  BasicResponseHeader(BasicResponseHeader&&) = default;
+
+  BasicResponseHeader& operator=(const BasicResponseHeader&) = default;
+
+  BasicResponseHeader& operator=(BasicResponseHeader&&) = default;
+
+  /**
+   * @brief appends [bytes] received from the server and parses the lines they
+   * complete, returns the last field they completed, with an empty name if
+   * they completed none
+   *
+   */
+  Field Push(string_view_type bytes) {
+    size_type fields = fields_.size();
+
+    bytes_.append(bytes.data(), bytes.size());
+    Parse();
+
+    if (fields_.size() == fields) return Field{};
+    return MakeField(fields_.back());
+  }
+
+  void PushCopy(const byte_type* data, size_type total_bytes) {
+    Push(string_view_type{data, total_bytes});
+  }
+
+  /**
+   * @brief finds the value of the last [name] field of the final block, names
+   * are compared case-insensitively
+   *
+   */
+  bool Find(string_view_type name, string_view_type* value) const {
+    if (index_.empty() || blocks_.empty()) return false;
+
+    size_type mask = index_.size() - 1;
+    for (size_type slot = Hash(name) & mask;; slot = (slot + 1) & mask) {
+      uint32_t entry = index_[slot];
+      if (entry == 0) return false;
+
+      Field field = MakeField(fields_[entry - 1]);
+      if (NameEqual(field.name, name)) {
+        *value = field.value;
+        return true;
+      }
+    }
+  }
+
+  /**
+   * @brief finds the value of the last [name] field of [block], searched
+   * linearly
+   *
+   */
+  bool Find(size_type block, string_view_type name,
+            string_view_type* value) const {
+    if (block >= blocks_.size()) return false;
+
+    bool found = false;
+    size_type first = blocks_[block].first_field;
+    for (size_type i = first; i < first + FieldCount(block); i++) {
+      Field field = MakeField(fields_[i]);
+      if (NameEqual(field.name, name)) {
+        *value = field.value;
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  // true if the final block has a [name] field
+  bool Contains(string_view_type name) const {
+    string_view_type value{};
+    return Find(name, &value);
+  }
+
+  // value of the last [name] field of the final block
+  string_view_type operator[](string_view_type name) const {
+    string_view_type value{};
+    if (!Find(name, &value))
+      throw std::out_of_range{"Response header field not found"};
+    return value;
+  }
+
+  // number of status lines received, one per response
+  size_type block_count() const { return blocks_.size(); }
+
+  // number of fields of the final block
+  size_type size() const {
+    return blocks_.empty() ? 0 : FieldCount(blocks_.size() - 1);
+  }
+
+  bool Empty() const { return size() == 0; }
+
+  // field [i] of the final block in order of receipt, e.g. to read every
+  // Set-Cookie
+  Field field(size_type i) const {
+    return MakeField(fields_[blocks_.back().first_field + i]);
+  }
+
+  // status line of [block], e.g. HTTP/1.1 200 OK
+  string_view_type status_line(size_type block) const {
+    return Bytes(blocks_[block].status_offset, blocks_[block].status_size);
+  }
+
+  string_view_type status_line() const {
+    return blocks_.empty() ? string_view_type{}
+                           : status_line(blocks_.size() - 1);
+  }
+
+  // status code of [block], 0 if it has no status line
+  int status_code(size_type block) const { return blocks_[block].status_code; }
+
+  int status_code() const {
+    return blocks_.empty() ? 0 : blocks_.back().status_code;
+  }
+
+  // total bytes received
+  size_type total_size() const { return bytes_.size(); }
+
+  // the headers as received from the server
+  string_type ToString() const& { return bytes_; }
+
+  string_type ToString() && {
+    string_type result = std::move(bytes_);
+    Clear();
+    return result;
+  }
+
+  void Save(std::basic_ofstream<byte_type, byte_traits>* file) const {
+    file->write(bytes_.data(), bytes_.size());
+  }
+
+  void Clear() {
+    bytes_.clear();
+    fields_.clear();
+    blocks_.clear();
+    index_.clear();
+    line_start_ = 0;
+    scanned_ = 0;
+    colon_ = no_colon;
+  }
+};
+
+typedef BasicResponseHeader<char> ResponseHeader;
+
+// name of the header buffer before headers were parsed
+typedef ResponseHeader ResponseHeaderBuffer;
+
+};  // namespace swish
+
+#endif
@@ -0,0 +1,374 @@
+#ifndef ______lib_SWISH___resumable_download_h
+#define ______lib_SWISH___resumable_download_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include "file_sink.h"
+
+#if defined(SWISH_HAS_FILE_SINK)
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "client.h"
+
+namespace swish {
+
+struct ResumableDownloadOptions {
+  // bytes received between two checkpoints
+  uint64_t checkpoint_interval = 8 * 1024 * 1024;
+
+  // file holding the progress of the download, [path].swish-checkpoint if
+  // empty
+  std::string checkpoint_path{};
+
+  // write mode and mapped window size, offsets and truncation are managed by
+  // the download
+  FileSinkOptions file{};
+};
+
+/**
+ * @brief progress of an interrupted download, persisted next to the file.
+ *
+ * A download is only resumed for the same url and when the server gave a
+ * validator, so a changed object is never spliced onto an older prefix.
+ */
+struct DownloadCheckpoint {
+  std::string url{};
+  std::string etag{};
+  std::string last_modified{};
+
+  // bytes of the file known to be on disk
+  uint64_t committed = 0;
+
+  static constexpr const char magic[] = "swish-checkpoint 1";
+
+  // value sent as If-Range, the ETag is preferred as it is a strong validator
+  std::string_view validator() const {
+    return etag.empty() ? std::string_view{last_modified}
+                        : std::string_view{etag};
+  }
+
+  bool Load(const std::string& path) {
+    std::ifstream file{path};
+    std::string header{}, committed_line{};
+
+    if (!std::getline(file, header) || header != magic) return false;
+
+    if (!std::getline(file, url) || !std::getline(file, etag) ||
+        !std::getline(file, last_modified) ||
+        !std::getline(file, committed_line))
+      return false;
+
+    return std::from_chars(committed_line.data(),
+                           committed_line.data() + committed_line.size(),
+                           committed)
+               .ec == std::errc{};
+  }
+
+  // replaces the checkpoint at [path] at once, a crash leaves either version
+  bool Store(const std::string& path) const {
+    std::string temporary_path = path + ".tmp";
+
+    {
+      std::ofstream file{temporary_path, std::ios::trunc};
+      file << magic << '\n'
+           << url << '\n'
+           << etag << '\n'
+           << last_modified << '\n'
+           << committed << '\n';
+      file.flush();
+      if (!file.good()) return false;
+    }
+
+    return std::rename(temporary_path.c_str(), path.c_str()) == 0;
+  }
+};
+
+namespace {
+
+// bytes [first, last] of [total] from a Content-Range value, false if the
+// value is not a satisfied byte range
+inline bool ParseContentRange(std::string_view value, uint64_t* first,
+                              uint64_t* total) {
+  constexpr std::string_view unit = "bytes ";
+  if (value.substr(0, unit.size()) != unit) return false;
+  value.remove_prefix(unit.size());
+
+  const char* end = value.data() + value.size();
+
+  auto [range_end, range_error] = std::from_chars(value.data(), end, *first);
+  if (range_error != std::errc{}) return false;
+
+  const char* slash = std::find(range_end, end, '/');
+  if (slash == end) return false;
+
+  return std::from_chars(slash + 1, end, *total).ec == std::errc{};
+}
+
+// writes a full response from the start of the file, or a partial one of the
+// range asked for from the checkpoint, and leaves the file untouched for any
+// other response
+struct ResumeSink {
+  enum class Target { Undecided, Restart, Append, Discard };
+
+  std::string path{};
+  FileSinkOptions file_options{};
+  const DownloadCheckpoint* previous = nullptr;
+  std::string checkpoint_path{};
+  uint64_t checkpoint_interval = 0;
+
+  Target target = Target::Undecided;
+  std::unique_ptr<PreallocatedFileSink> file{};
+  uint64_t unflushed = 0;
+
+  // status, validators and range of the response being received
+  long response_code = 0;
+  DownloadCheckpoint current{};
+  int64_t range_first = -1;
+  int64_t range_total = -1;
+
+  void Header(std::string_view line) {
+    // a new status line starts the headers of another response
+    if (line.substr(0, 5) == "HTTP/") {
+      size_t code_start = std::min(line.find(' '), line.size() - 1) + 1;
+      response_code = 0;
+      std::from_chars(line.data() + code_start, line.data() + line.size(),
+                      response_code);
+      current.etag.clear();
+      current.last_modified.clear();
+      range_first = -1;
+      range_total = -1;
+      return;
+    }
+
+    std::string_view value{};
+    if (HeaderFieldValue(line, "ETag", &value)) {
+      current.etag = value;
+    } else if (HeaderFieldValue(line, "Last-Modified", &value)) {
+      current.last_modified = value;
+    } else if (HeaderFieldValue(line, "Content-Range", &value)) {
+      uint64_t first = 0, total = 0;
+      if (ParseContentRange(value, &first, &total)) {
+        range_first = static_cast<int64_t>(first);
+        range_total = static_cast<int64_t>(total);
+      } else if (value.substr(0, 8) == "bytes */") {
+        std::from_chars(value.data() + 8, value.data() + value.size(), total);
+        range_total = static_cast<int64_t>(total);
+      }
+    }
+  }
+
+  // picks where the body goes once the final response is known, redirect
+  // and error bodies are dropped
+  Target Decide() {
+    if (target != Target::Undecided) return target;
+
+    FileSinkOptions options = file_options;
+
+    // only a fresh request writes a full response. One to a resumed request
+    // means the object changed, it is dropped and fetched again from its start
+    if (response_code == static_cast<long>(http::ResponseCode::OK) &&
+        previous == nullptr) {
+      options.offset = 0;
+      options.truncate = true;
+      target = Target::Restart;
+    } else if (response_code ==
+                   static_cast<long>(http::ResponseCode::PartialContent) &&
+               previous != nullptr &&
+               range_first == static_cast<int64_t>(previous->committed)) {
+      options.offset = previous->committed;
+      options.truncate = false;
+      target = Target::Append;
+    } else {
+      return Target::Discard;
+    }
+
+    file = std::make_unique<PreallocatedFileSink>(path, options);
+    return target;
+  }
+
+  // bytes of the file on disk once the sink is flushed
+  uint64_t committed() const {
+    return file == nullptr ? 0 : file->options().offset + file->written();
+  }
+
+  // persists everything received so far, false if it can not be resumed
+  bool Checkpoint() {
+    // a partial response need not repeat the validators it was asked with
+    if (target == Target::Append && current.validator().empty()) {
+      current.etag = previous->etag;
+      current.last_modified = previous->last_modified;
+    }
+
+    if (file == nullptr || current.validator().empty()) return false;
+    if (!file->Flush()) return false;
+
+    current.committed = committed();
+    unflushed = 0;
+    return current.Store(checkpoint_path);
+  }
+
+  void Reserve(size_t total_bytes) {
+    if (Decide() == Target::Discard) return;
+    file->Reserve(total_bytes);
+  }
+
+  bool Write(std::string_view fragment) {
+    if (Decide() == Target::Discard) return true;
+
+    if (!file->Write(fragment)) return false;
+
+    unflushed += fragment.size();
+    if (checkpoint_interval > 0 && unflushed >= checkpoint_interval)
+      Checkpoint();
+
+    return true;
+  }
+};
+
+};  // namespace
+
+/**
+ * @brief Downloads [url] into the file at [path] through [client], resuming
+ * from the checkpoint of an earlier interrupted download when there is one.
+ *
+ * Progress is checkpointed every [options.checkpoint_interval] bytes and when
+ * the transfer fails, after the received data was flushed to disk. The next
+ * call asks for the rest of the object with an If-Range of the checkpointed
+ * ETag or Last-Modified, a server whose object changed sends all of it again.
+ * The checkpoint is removed once the file is complete.
+ *
+ * Bodies of responses other than 200 and 206 are not written and leave the
+ * file as it was, their response is returned with an OK status.
+ */
+inline std::pair<Response<BasicResponseBuffer<char>>, StatusCode>
+ResumableDownload(Client* client, std::string_view url,
+                  const std::string& path,
+                  const ResumableDownloadOptions& options = {}) {
+  std::string checkpoint_path = options.checkpoint_path.empty()
+                                    ? path + ".swish-checkpoint"
+                                    : options.checkpoint_path;
+
+  DownloadCheckpoint previous{};
+  bool resuming = previous.Load(checkpoint_path) && previous.url == url &&
+                  !previous.validator().empty() && previous.committed > 0;
+
+  struct stat file_stat {};
+  if (resuming && (stat(path.c_str(), &file_stat) != 0 ||
+                   static_cast<uint64_t>(file_stat.st_size) <
+                       previous.committed))
+    resuming = false;
+
+  if (!resuming) {
+    previous = DownloadCheckpoint{};
+    previous.url = url;
+    std::remove(checkpoint_path.c_str());
+  }
+
+  Configuration& configuration = client->configuration;
+  uint64_t resume_from = configuration.resume_from;
+
+  if (resuming) {
+    configuration.resume_from = previous.committed;
+    configuration.header.Emplace("If-Range", previous.validator());
+  }
+
+  ResumeSink sink{};
+  sink.path = path;
+  sink.file_options = options.file;
+  sink.previous = resuming ? &previous : nullptr;
+  sink.checkpoint_path = checkpoint_path;
+  sink.checkpoint_interval = options.checkpoint_interval;
+  sink.current.url = previous.url;
+
+  auto [response, status] = client->Stream(url, sink);
+
+  configuration.resume_from = resume_from;
+  if (resuming) configuration.header.Pop("If-Range");
+
+  // the server answers an If-Range that no longer matches with the full
+  // object, which libcurl refuses for a resumed request, it is fetched again
+  // from its start
+  bool object_changed =
+      resuming && sink.response_code == static_cast<long>(http::ResponseCode::OK);
+
+  // the checkpoint either covered the whole object or a larger older version
+  bool range_unsatisfiable =
+      resuming && IsOK(status) &&
+      sink.response_code ==
+          static_cast<long>(http::ResponseCode::RangeNotSatisfiable);
+
+  if (object_changed || range_unsatisfiable) {
+    std::remove(checkpoint_path.c_str());
+
+    if (range_unsatisfiable &&
+        sink.range_total == static_cast<int64_t>(previous.committed)) {
+      if (truncate(path.c_str(), static_cast<off_t>(previous.committed)) != 0)
+        status = StatusCode::WriteCallbackError;
+      return std::make_pair(std::move(response), status);
+    }
+
+    return ResumableDownload(client, url, path, options);
+  }
+
+  if (!IsOK(status)) {
+    // keeps what was received, or the earlier checkpoint if nothing was
+    if (sink.file != nullptr && !sink.Checkpoint() &&
+        sink.target == ResumeSink::Target::Restart)
+      std::remove(checkpoint_path.c_str());
+    return std::make_pair(std::move(response), status);
+  }
+
+  if (sink.file != nullptr) {
+    // drops whatever an earlier attempt left past the end of the object
+    if (!sink.file->Commit() ||
+        (sink.target == ResumeSink::Target::Append &&
+         truncate(path.c_str(), static_cast<off_t>(sink.committed())) != 0)) {
+      sink.Checkpoint();
+      return std::make_pair(std::move(response),
+                            StatusCode::WriteCallbackError);
+    }
+    std::remove(checkpoint_path.c_str());
+  }
+
+  return std::make_pair(std::move(response), status);
+}
+
+};  // namespace swish
+
+#endif
+
+#endif
@@ -0,0 +1,368 @@
+#ifndef ______lib_SWISH___retry_h
+#define ______lib_SWISH___retry_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <thread>
+
+#include <curl/curl.h>
+
+#include "circuit_breaker.h"
+#include "metrics.h"
+#include "response_header.h"
+#include "status_codes.h"
+
+namespace swish {
+
+/**
+ * @brief Token bucket bounding retries to a fraction of the requests made, so
+ * retries do not multiply traffic to an overloaded server.
+ *
+ * Every request deposits [ratio] tokens and every retry withdraws one. The
+ * bucket also refills by [minimum_per_second] so rarely used clients may
+ * still retry, and holds at most [capacity] tokens.
+ */
+class RetryBudget {
+  using clock = std::chrono::steady_clock;
+
+  mutable std::mutex mutex_{};
+  double ratio_ = 0;
+  double minimum_per_second_ = 0;
+  double capacity_ = 0;
+  double balance_ = 0;
+  clock::time_point last_refill_{clock::now()};
+
+  void Refill(clock::time_point now) {
+    double seconds = std::chrono::duration<double>(now - last_refill_).count();
+    last_refill_ = now;
+    balance_ = std::min(balance_ + minimum_per_second_ * seconds, capacity_);
+  }
+
+ public:
+  explicit RetryBudget(double ratio = 0.1, double minimum_per_second = 10,
+                       double capacity = 100)
+      : ratio_{ratio},
+        minimum_per_second_{minimum_per_second},
+        capacity_{capacity},
+        balance_{std::min(minimum_per_second, capacity)} {}
+
+  // budget shared by every client of the process
+  static RetryBudget& Global() {
+    static RetryBudget budget{};
+    return budget;
+  }
+
+  // a request is made
+  void Deposit() {
+    std::lock_guard lock{mutex_};
+    balance_ = std::min(balance_ + ratio_, capacity_);
+  }
+
+  // takes a token for a retry, false if none is left
+  bool Withdraw() {
+    std::lock_guard lock{mutex_};
+    Refill(clock::now());
+    if (balance_ < 1) return false;
+    balance_ -= 1;
+    return true;
+  }
+
+  double balance() const {
+    std::lock_guard lock{mutex_};
+    return balance_;
+  }
+
+  RetryBudget(const RetryBudget&) = delete;
+
+  RetryBudget& operator=(const RetryBudget&) = delete;
+};
+
+struct RetryPolicy {
+  // attempts made at most, including the first one. 1 disables retries
+  uint32_t max_attempts = 1;
+
+  // the wait before attempt n is drawn uniformly from
+  // [0, min(max_delay, base_delay * 2^(n - 2))]
+  std::chrono::milliseconds base_delay{100};
+  std::chrono::milliseconds max_delay{10000};
+
+  // retry 429 and 5xx responses, not only failed transfers
+  bool retry_responses = true;
+
+  // wait as long as a Retry-After header given in seconds asks, giving up
+  // if that is longer than [max_delay]
+  bool respect_retry_after = true;
+
+  // retry requests that may have reached the server even if their method is
+  // not idempotent, e.g. POST. Requests that were never sent are always
+  // retried
+  bool retry_non_idempotent = false;
+
+  // retries are withdrawn from it, unbounded if null
+  RetryBudget* budget = &RetryBudget::Global();
+
+  bool enabled() const { return max_attempts > 1; }
+
+  // failures of the transfer itself worth another attempt
+  static bool Retryable(StatusCode status) {
+    switch (status) {
+      case StatusCode::HostResolutionError:
+      case StatusCode::ConnectionError:
+      case StatusCode::TimedOut:
+      case StatusCode::SendError:
+      case StatusCode::ReceiveError:
+      case StatusCode::NoServerResponse:
+      case StatusCode::PartialFile:
+      case StatusCode::HTTP2Error:
+      case StatusCode::HTTP2StreamError:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // responses that say the server may answer differently later
+  static bool Retryable(long response_code) {
+    return response_code == 429 ||
+           (response_code >= 500 && response_code <= 599 &&
+            response_code != 501 && response_code != 505);
+  }
+
+  static bool Idempotent(std::string_view method) {
+    return method == "GET" || method == "HEAD" || method == "PUT" ||
+           method == "DELETE" || method == "OPTIONS" || method == "TRACE";
+  }
+};
+
+/**
+ * @brief Retries of one request under a RetryPolicy, kept across its
+ * attempts on the same handle, which reuses the connection kept alive by the
+ * last one.
+ *
+ */
+class RetryState {
+  RetryPolicy policy_{};
+  uint32_t attempts_ = 1;
+
+  static std::chrono::milliseconds Jitter(std::chrono::milliseconds limit) {
+    thread_local std::minstd_rand engine{std::random_device{}()};
+    std::uniform_int_distribution<int64_t> distribution{0, limit.count()};
+    return std::chrono::milliseconds{distribution(engine)};
+  }
+
+  // whether a request with [status] and [response_code] is worth another
+  // attempt, and if it may safely be made
+  static bool Retryable(const RetryPolicy& policy, CURL* handle,
+                        StatusCode status, long response_code) {
+    bool failed = !IsOK(status);
+    if (failed ? !RetryPolicy::Retryable(status)
+               : !policy.retry_responses ||
+                     !RetryPolicy::Retryable(response_code))
+      return false;
+
+    // nothing was sent, the server never saw the request
+    curl_off_t pre_transfer = 0;
+    curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME_T, &pre_transfer);
+    if (failed && pre_transfer == 0) return true;
+
+    if (policy.retry_non_idempotent) return true;
+
+    char* method = nullptr;
+#if LIBCURL_VERSION_NUM >= 0x074800
+    curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_METHOD, &method);
+#endif
+    return method != nullptr && RetryPolicy::Idempotent(method);
+  }
+
+  static std::optional<std::chrono::milliseconds> RetryAfter(
+      const ResponseHeader& header) {
+    std::string_view value;
+    if (!header.Find("Retry-After", &value)) return std::nullopt;
+
+    uint64_t seconds = 0;
+    auto [end, error] =
+        std::from_chars(value.data(), value.data() + value.size(), seconds);
+    // HTTP dates are not honoured
+    if (error != std::errc{} || end != value.data() + value.size())
+      return std::nullopt;
+
+    return std::chrono::milliseconds{
+        std::min<uint64_t>(seconds, UINT32_MAX) * 1000};
+  }
+
+ public:
+  RetryState() = default;
+
+  // counts the request against the policy's budget
+  explicit RetryState(const RetryPolicy& policy) : policy_{policy} {
+    if (policy_.enabled() && policy_.budget != nullptr)
+      policy_.budget->Deposit();
+  }
+
+  /**
+   * @brief decides whether the attempt made on [handle] that ended with
+   * [status] and [header] is retried, returning the time to wait before the
+   * next one if so.
+   *
+   * [streamed_body] the response body was handed on as it arrived, the
+   * request is then only retried if none was received
+   */
+  std::optional<std::chrono::milliseconds> Next(CURL* handle,
+                                                StatusCode status,
+                                                const ResponseHeader& header,
+                                                bool streamed_body) {
+    if (attempts_ >= policy_.max_attempts) return std::nullopt;
+
+    long response_code = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response_code);
+    if (!Retryable(policy_, handle, status, response_code))
+      return std::nullopt;
+
+    if (streamed_body) {
+      curl_off_t received = 0;
+      curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &received);
+      if (received > 0) return std::nullopt;
+    }
+
+    // full jitter, the backoff doubles with every attempt
+    std::chrono::milliseconds ceiling = policy_.max_delay;
+    uint32_t doublings = attempts_ - 1;
+    if (doublings < 32)
+      ceiling = std::min(ceiling, policy_.base_delay * (int64_t{1} << doublings));
+    std::chrono::milliseconds delay = Jitter(ceiling);
+
+    if (IsOK(status) && policy_.respect_retry_after) {
+      auto retry_after = RetryAfter(header);
+      if (retry_after.has_value()) {
+        if (*retry_after > policy_.max_delay) return std::nullopt;
+        delay = std::max(delay, *retry_after);
+      }
+    }
+
+    if (policy_.budget != nullptr && !policy_.budget->Withdraw())
+      return std::nullopt;
+
+    attempts_++;
+    return delay;
+  }
+
+  // attempts made so far
+  uint32_t attempts() const { return attempts_; }
+};
+
+/**
+ * @brief Attempts of one request, as made by every client: the outcome of
+ * each is recorded in the metrics registry and counted by the circuit
+ * breaker of the host, and another one is made while the retry policy allows
+ * and the circuit stays closed.
+ *
+ */
+class RetryController {
+  RetryPolicy retry_policy_{};
+  RetryState retry_{};
+  CircuitBreakerPolicy breaker_policy_{};
+  CircuitBreaker* breaker_ = nullptr;
+  Metrics* metrics_ = nullptr;
+
+ public:
+  RetryController() = default;
+
+  RetryController(const RetryPolicy& retry_policy,
+                  const CircuitBreakerPolicy& breaker_policy,
+                  std::string_view url, Metrics* metrics)
+      : retry_policy_{retry_policy},
+        breaker_policy_{breaker_policy},
+        breaker_{CircuitBreakers::For(breaker_policy, url)},
+        metrics_{metrics} {}
+
+  // whether the circuit breaker lets the request be made, it is then counted
+  // against the retry budget
+  bool Admit() {
+    if (breaker_ != nullptr && !breaker_->Allow(breaker_policy_)) return false;
+
+    retry_ = RetryState{retry_policy_};
+    return true;
+  }
+
+  /**
+   * @brief records the attempt made on [handle] that ended with [status] and
+   * [header], returning the time to wait before the next one if it is
+   * retried.
+   *
+   * [streamed_body] the response body was handed on as it arrived
+   */
+  std::optional<std::chrono::milliseconds> Next(CURL* handle,
+                                                StatusCode status,
+                                                const ResponseHeader& header,
+                                                bool streamed_body) {
+    if (metrics_ != nullptr) metrics_->Record(handle, status);
+    if (breaker_ != nullptr) breaker_->Record(breaker_policy_, handle, status);
+
+    auto delay = retry_.Next(handle, status, header, streamed_body);
+
+    // the outcome of the last attempt stands if the circuit opened
+    if (delay.has_value() && breaker_ != nullptr &&
+        !breaker_->Allow(breaker_policy_))
+      delay.reset();
+
+    return delay;
+  }
+
+  /**
+   * @brief makes attempts of a blocking request until one is not retried,
+   * sleeping through the backoff in between, and returns the status of the
+   * last one.
+   *
+   * [attempt] performs the request and returns its status, [handle] returns
+   * the handle it was made on and [reset] readies the request for another
+   * attempt
+   */
+  template <typename Attempt, typename Handle, typename Reset>
+  StatusCode Perform(Attempt&& attempt, Handle&& handle,
+                     const ResponseHeader& header, bool streamed_body,
+                     Reset&& reset) {
+    while (true) {
+      StatusCode status = attempt();
+
+      auto delay = Next(handle(), status, header, streamed_body);
+      if (!delay.has_value()) return status;
+
+      reset();
+      std::this_thread::sleep_for(*delay);
+    }
+  }
+};
+
+};  // namespace swish
+
+#endif
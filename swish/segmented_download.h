@@ -0,0 +1,255 @@
+#ifndef ______lib_SWISH___segmented_download_h
+#define ______lib_SWISH___segmented_download_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include "file_sink.h"
+
+#if defined(SWISH_HAS_FILE_SINK)
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "client.h"
+
+namespace swish {
+
+struct SegmentedDownloadOptions {
+  // number of ranges fetched concurrently
+  size_t segments = 4;
+
+  // objects too small to give every segment this many bytes use fewer
+  uint64_t minimum_segment_size = 4 * 1024 * 1024;
+
+  // write mode and mapped window size, offsets and truncation are managed by
+  // the download
+  FileSinkOptions file{};
+};
+
+namespace {
+
+// writes one range to its offset, refusing anything but a partial response
+struct SegmentSink {
+  CURL* handle = nullptr;
+  uint64_t length = 0;
+  bool accepted = false;
+  std::unique_ptr<PreallocatedFileSink> file{};
+
+  bool Write(std::string_view fragment) {
+    if (!accepted) {
+      long response_code = 0;
+      curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response_code);
+      accepted = response_code ==
+                 static_cast<long>(http::ResponseCode::PartialContent);
+      if (!accepted) return false;
+    }
+
+    if (file->written() + fragment.size() > length) return false;
+
+    return file->Write(fragment);
+  }
+};
+
+};  // namespace
+
+/**
+ * @brief Downloads [url] into the file at [path] over several concurrent
+ * byte-range requests, each on its own connection and written straight to its
+ * offset in the file.
+ *
+ * A HEAD request through [client] learns the size and range support of the
+ * object. Objects whose server does not accept byte ranges, whose size is not
+ * known or that are too small to split are downloaded as a single stream
+ * through [client], as is any object whose server ignores the ranges.
+ *
+ * Returns the response of the HEAD request, or of the single stream download,
+ * and the first error met.
+ */
+inline std::pair<Response<BasicResponseBuffer<char>>, StatusCode>
+SegmentedDownload(Client* client, std::string_view url, const std::string& path,
+                  const SegmentedDownloadOptions& options = {}) {
+  auto single_stream = [&]() {
+    FileSinkOptions file_options = options.file;
+    file_options.offset = 0;
+    file_options.truncate = true;
+
+    PreallocatedFileSink file{path, file_options};
+    return client->Download(url, &file);
+  };
+
+  auto [probe, status] = client->Head(url);
+  if (!IsOK(status)) return std::make_pair(std::move(probe), status);
+
+  // lookups only see the last response when redirects were followed
+  std::string_view length_value{}, ranges_value{};
+  probe.header.Find("Content-Length", &length_value);
+  probe.header.Find("Accept-Ranges", &ranges_value);
+
+  int64_t content_length = ParseContentLengthValue(length_value);
+  bool accepts_ranges = ranges_value == "bytes";
+
+  uint64_t segment_count = std::min<uint64_t>(
+      options.segments,
+      content_length > 0 ? static_cast<uint64_t>(content_length) /
+                               std::max<uint64_t>(options.minimum_segment_size, 1)
+                         : 0);
+
+  if (probe.response_code() != http::ResponseCode::OK || !accepts_ranges ||
+      segment_count < 2)
+    return single_stream();
+
+  uint64_t total_size = static_cast<uint64_t>(content_length);
+
+  // creates the file and allocates all of it up front
+  {
+    FileSinkOptions file_options = options.file;
+    file_options.offset = 0;
+    file_options.truncate = true;
+
+    PreallocatedFileSink file{path, file_options};
+    if (!file.is_open())
+      return std::make_pair(std::move(probe), StatusCode::WriteCallbackError);
+    file.Reserve(total_size);
+  }
+
+  CURLM* multi_handle = curl_multi_init();
+  if (multi_handle == nullptr)
+    return std::make_pair(std::move(probe), StatusCode::InitializationError);
+
+  std::vector<SegmentSink> segments(segment_count);
+  uint64_t segment_size = total_size / segment_count;
+
+  for (uint64_t i = 0; i < segment_count && IsOK(status); i++) {
+    uint64_t first = i * segment_size;
+    uint64_t last =
+        i + 1 == segment_count ? total_size - 1 : first + segment_size - 1;
+
+    FileSinkOptions file_options = options.file;
+    file_options.offset = first;
+    file_options.truncate = false;
+
+    SegmentSink& segment = segments[i];
+    segment.handle = curl_easy_init();
+    segment.length = last - first + 1;
+    segment.file = std::make_unique<PreallocatedFileSink>(path, file_options);
+
+    if (segment.handle == nullptr) {
+      status = StatusCode::InitializationError;
+      break;
+    }
+
+    if (!segment.file->is_open()) {
+      status = StatusCode::WriteCallbackError;
+      break;
+    }
+
+    // the range was allocated with the file, reserving it lets Mapped mode
+    // map it instead of falling back to pwrite
+    segment.file->Reserve(segment.length);
+
+    std::string range = std::to_string(first) + "-" + std::to_string(last);
+
+    status = client->configuration.ConfigHandle(segment.handle);
+    if (!IsOK(status)) break;
+
+    status = static_cast<StatusCode>(
+        curl_easy_setopt(segment.handle, CURLOPT_URL, url.data()));
+    if (!IsOK(status)) break;
+
+    status = static_cast<StatusCode>(
+        curl_easy_setopt(segment.handle, CURLOPT_RANGE, range.c_str()));
+    if (!IsOK(status)) break;
+
+    status = static_cast<StatusCode>(
+        curl_easy_setopt(segment.handle, CURLOPT_WRITEFUNCTION,
+                         ResponseSinkCallback<SegmentSink>));
+    if (!IsOK(status)) break;
+
+    status = static_cast<StatusCode>(
+        curl_easy_setopt(segment.handle, CURLOPT_WRITEDATA, &segment));
+    if (!IsOK(status)) break;
+
+    if (curl_multi_add_handle(multi_handle, segment.handle) != CURLM_OK)
+      status = StatusCode::InitializationError;
+  }
+
+  int running = IsOK(status) ? 1 : 0;
+  while (running > 0) {
+    curl_multi_perform(multi_handle, &running);
+    if (running > 0) curl_multi_poll(multi_handle, nullptr, 0, 1000, nullptr);
+  }
+
+  bool ranges_ignored = false;
+
+  CURLMsg* message = nullptr;
+  int queued = 0;
+  while ((message = curl_multi_info_read(multi_handle, &queued)) != nullptr) {
+    if (message->msg != CURLMSG_DONE || message->data.result == CURLE_OK)
+      continue;
+
+    // a response other than a partial one arrived, e.g. the full object.
+    // Failures before any response, such as a refused connection, are errors
+    long response_code = 0;
+    curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE,
+                      &response_code);
+    if (response_code != 0 &&
+        response_code != static_cast<long>(http::ResponseCode::PartialContent))
+      ranges_ignored = true;
+
+    if (IsOK(status)) status = static_cast<StatusCode>(message->data.result);
+  }
+
+  for (auto& segment : segments) {
+    if (IsOK(status) && segment.file->written() != segment.length)
+      status = StatusCode::PartialFile;
+
+    if (IsOK(status) && !segment.file->Commit())
+      status = StatusCode::WriteCallbackError;
+  }
+
+  for (auto& segment : segments) {
+    if (segment.handle == nullptr) continue;
+    curl_multi_remove_handle(multi_handle, segment.handle);
+    curl_easy_cleanup(segment.handle);
+  }
+  curl_multi_cleanup(multi_handle);
+
+  if (ranges_ignored) return single_stream();
+
+  return std::make_pair(std::move(probe), status);
+}
+
+};  // namespace swish
+
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef ______lib_SWISH___shared_state_h
+#define ______lib_SWISH___shared_state_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <cassert>
+#include <cstdint>
+
+#include <mutex>
+
+#include <curl/curl.h>
+
+namespace swish {
+
+// data SharedState shares between the clients using it
+enum SharedData : uint32_t {
+  kShareCookies = 1 << 0,
+  kShareDNS = 1 << 1,
+  kShareSSLSession = 1 << 2,
+  // libcurl does not support a shared connection cache being used by several
+  // threads at once, only share connections between clients on one thread
+  kShareConnections = 1 << 3,
+
+  kShareDefault = kShareDNS | kShareSSLSession
+};
+
+/**
+ * @brief DNS, TLS session, cookie and connection caches shared between every
+ * client whose Configuration::shared_state points to it, so lookups and full
+ * handshakes to a host are paid once per process instead of once per client.
+ *
+ * Each kind of data has a lock of its own. libcurl takes it for every access
+ * to a shared cache, lookups included, so clients on different threads
+ * serialize on each use of the same cache but not across caches.
+ *
+ * Clients and transfers keep the SharedState their handles are attached to
+ * alive, and detach the handles before letting go of it, so it is only cleaned
+ * up once no handle uses it.
+ */
+class SharedState {
+  CURLSH* share_handle_ = nullptr;
+
+  std::mutex locks_[CURL_LOCK_DATA_LAST]{};
+
+  // libcurl asks for single access to every cache, lookups included
+  static void Lock(CURL*, curl_lock_data data, curl_lock_access,
+                   void* user_data) {
+    static_cast<SharedState*>(user_data)->locks_[data].lock();
+  }
+
+  static void Unlock(CURL*, curl_lock_data data, void* user_data) {
+    static_cast<SharedState*>(user_data)->locks_[data].unlock();
+  }
+
+  void Share(curl_lock_data data) {
+    curl_share_setopt(share_handle_, CURLSHOPT_SHARE, data);
+  }
+
+ public:
+  explicit SharedState(uint32_t shared_data = kShareDefault)
+      : share_handle_(curl_share_init()) {
+    assert(share_handle_ != nullptr);
+
+    curl_share_setopt(share_handle_, CURLSHOPT_LOCKFUNC, Lock);
+    curl_share_setopt(share_handle_, CURLSHOPT_UNLOCKFUNC, Unlock);
+    curl_share_setopt(share_handle_, CURLSHOPT_USERDATA, this);
+
+    if (shared_data & kShareCookies) Share(CURL_LOCK_DATA_COOKIE);
+    if (shared_data & kShareDNS) Share(CURL_LOCK_DATA_DNS);
+    if (shared_data & kShareSSLSession) Share(CURL_LOCK_DATA_SSL_SESSION);
+    if (shared_data & kShareConnections) Share(CURL_LOCK_DATA_CONNECT);
+  }
+
+  CURLSH* share_handle() { return share_handle_; }
+
+  SharedState(const SharedState&) = delete;
+
+  SharedState& operator=(const SharedState&) = delete;
+
+  SharedState(SharedState&&) = delete;
+
+  SharedState& operator=(SharedState&&) = delete;
+
+  ~SharedState() noexcept { curl_share_cleanup(share_handle_); }
+};
+
+};  // namespace swish
+
+#endif
@@ -258,7 +258,13 @@ enum class StatusCode {
   HTTP2StreamError = CURLE_HTTP2_STREAM,
 
   // An API function was called from inside a callback.
-  CallbackRecursiveAPI_Call = CURLE_RECURSIVE_API_CALL
+  CallbackRecursiveAPI_Call = CURLE_RECURSIVE_API_CALL,
+
+  // codes of swish itself, far above the ones of libcurl so they do not
+  // collide with codes added by later libcurl versions
+
+  // The request was not sent, the circuit breaker of its host is open.
+  CircuitOpen = 1 << 16
 
 };
 
@@ -266,6 +272,9 @@ inline bool IsOK(StatusCode status) { return status == StatusCode::OK; }
 
 // provides interface to curl err buffer
 std::string InterpretStatusCode(StatusCode status) {
+  if (status == StatusCode::CircuitOpen)
+    return "Circuit breaker of the host is open";
+
   CURLcode c_status = static_cast<CURLcode>(status);
 
   return std::string{curl_easy_strerror(c_status)};
@@ -25,7 +25,21 @@
  * 
  */
 
+#include "async.h"
+#include "bandwidth.h"
+#include "circuit_breaker.h"
 #include "client.h"
+#include "client_pool.h"
+#include "hedge.h"
+#include "metrics.h"
+#include "multi_client.h"
+#include "prepared_request.h"
+#include "progress.h"
+#include "request_stream.h"
+#include "resumable_download.h"
+#include "retry.h"
+#include "segmented_download.h"
+#include "transfer_watch.h"
 
 
 #endif
\ No newline at end of file
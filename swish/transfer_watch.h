@@ -0,0 +1,436 @@
+#ifndef ______lib_SWISH___transfer_watch_h
+#define ______lib_SWISH___transfer_watch_h
+/**
+ * @author Basit Ayantunde (rlamarrr@gmail.com)
+ * @brief Templated CURL requests abstraction
+ * @version 0.1
+ * 
+ * @copyright Copyright (c) 2018
+ *      __                __         ____                                    __         
+ *     /\ \        __    /\ \       /\  _`\                   __            /\ \        
+ *     \ \ \      /\_\   \ \ \____  \ \,\L\_\    __  __  __  /\_\     ____  \ \ \___    
+ *      \ \ \  __ \/\ \   \ \ '__`\  \/_\__ \   /\ \/\ \/\ \ \/\ \   /',__\  \ \  _ `\  
+ *       \ \ \L\ \ \ \ \   \ \ \L\ \   /\ \L\ \ \ \ \_/ \_/ \ \ \ \ /\__, `\  \ \ \ \ \ 
+ *        \ \____/  \ \_\   \ \_,__/   \ `\____\ \ \___x___/'  \ \_\\/\____/   \ \_\ \_\
+ *         \/___/    \/_/    \/___/     \/_____/  \/__//__/     \/_/ \/___/     \/_/\/_/
+ *                                                                                
+ *                                                                                
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <curl/curl.h>
+
+#include "bandwidth.h"
+#include "http.h"
+#include "progress.h"
+#include "response.h"
+#include "status_codes.h"
+#include "utils.h"
+
+namespace swish {
+
+/**
+ * @brief Recent throughput of completed downloads per host, the baseline
+ * slow transfers are judged against.
+ *
+ */
+class ThroughputBaselines {
+  struct Baseline {
+    double rate = 0;
+    uint32_t samples = 0;
+  };
+
+  // weight of the latest download in the baseline
+  static constexpr double weight = 0.2;
+
+  mutable std::mutex mutex_{};
+  std::map<std::string, Baseline, std::less<>> hosts_{};
+
+ public:
+  static ThroughputBaselines& Global() {
+    static ThroughputBaselines baselines{};
+    return baselines;
+  }
+
+  // baseline of [host] in bytes per second, 0 if fewer than
+  // [minimum_samples] downloads were recorded
+  double Get(std::string_view host, uint32_t minimum_samples) const {
+    std::lock_guard lock{mutex_};
+    auto baseline = hosts_.find(host);
+    if (baseline == hosts_.end() || baseline->second.samples < minimum_samples)
+      return 0;
+    return baseline->second.rate;
+  }
+
+  // adds a download of [host] at [rate] bytes per second
+  void Update(std::string_view host, double rate) {
+    std::lock_guard lock{mutex_};
+    auto baseline = hosts_.find(host);
+    if (baseline == hosts_.end())
+      baseline = hosts_.emplace(std::string{host}, Baseline{}).first;
+
+    Baseline& entry = baseline->second;
+    entry.rate =
+        entry.samples == 0 ? rate : entry.rate + weight * (rate - entry.rate);
+    entry.samples++;
+  }
+};
+
+struct StallPolicy {
+  // transfers are only judged when enabled
+  bool enabled = false;
+
+  // a download stalls once its smoothed rate stays below this fraction of its
+  // host's baseline for [grace_period]
+  double minimum_ratio = 0.1;
+  std::chrono::milliseconds grace_period{2000};
+
+  // not judged until it received data for this long, e.g. during slow start
+  std::chrono::milliseconds warm_up{1000};
+
+  // completed downloads of a host needed before its baseline is trusted
+  uint32_t minimum_samples = 3;
+
+  // downloads smaller than this are dominated by latency, they do not update
+  // the baseline
+  uint64_t minimum_sample_bytes = 256 * 1024;
+
+  // time constant of the smoothed transfer rates
+  std::chrono::milliseconds time_constant{1000};
+
+  // baselines to judge by and update, the process-wide ones if null
+  ThroughputBaselines* baselines = nullptr;
+};
+
+/**
+ * @brief Follows a transfer from libcurl's transfer info callback, smoothing
+ * its receive and send rates and aborting it once its download stalls
+ * according to a StallPolicy. A stalled transfer fails with
+ * StatusCode::CallbackAborted and its Throughput is marked stalled.
+ *
+ * A transfer with a BandwidthShare is paused whenever its traffic class goes
+ * over budget. Transfers driven by a multi handle are paused with
+ * curl_easy_pause and must be resumed with ResumeThrottled() by the loop
+ * driving them. A blocking perform is held within the callback instead, the
+ * thread is not reading from the socket meanwhile.
+ *
+ * The progress callback configured for the request is still called.
+ */
+class TransferWatch {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  // what drives the watched transfer
+  enum class Driver { Easy, Multi };
+
+ private:
+  // longest a blocking perform is held before its budget is checked again
+  static constexpr std::chrono::milliseconds hold_interval{50};
+
+  Driver driver_ = Driver::Easy;
+  CURL* handle_ = nullptr;
+  StallPolicy policy_{};
+  bool active_ = false;
+
+  // the transfer info callback the watch stands in for
+  curl_xferinfo_callback forward_ = nullptr;
+  void* forward_data_ = nullptr;
+
+  ThroughputEstimator receive_{};
+  ThroughputEstimator send_{};
+  uint64_t received_ = 0;
+  uint64_t sent_ = 0;
+
+  clock::time_point last_tick_{};
+  clock::time_point first_byte_{};
+  clock::time_point below_since_{};
+  bool receiving_ = false;
+  bool below_ = false;
+  bool stalled_ = false;
+
+  BandwidthShare share_{};
+  // paused until its traffic class has budget again
+  bool throttled_ = false;
+  // throttled at some point, its rates say nothing of the link
+  bool was_throttled_ = false;
+
+  std::string host_{};
+  // fetched when the download is first judged, negative until then
+  double baseline_ = -1;
+
+  // finished along with the transfer
+  ProgressSlot* progress_slot_ = nullptr;
+
+  ThroughputBaselines& baselines() const {
+    return policy_.baselines != nullptr ? *policy_.baselines
+                                        : ThroughputBaselines::Global();
+  }
+
+  const std::string& host() {
+    if (host_.empty()) {
+      char* url = nullptr;
+      curl_easy_getinfo(handle_, CURLINFO_EFFECTIVE_URL, &url);
+      host_ = http::UrlHost(url == nullptr ? "" : url);
+    }
+    return host_;
+  }
+
+  bool Stalled(clock::time_point now, uint64_t to_download) {
+    if (!policy_.enabled || !receiving_ ||
+        (to_download > 0 && received_ >= to_download))
+      return false;
+
+    if (now - first_byte_ < policy_.warm_up) return false;
+
+    if (baseline_ < 0) baseline_ = baselines().Get(host(), policy_.minimum_samples);
+
+    if (baseline_ <= 0 || receive_.rate() >= baseline_ * policy_.minimum_ratio) {
+      below_ = false;
+      return false;
+    }
+
+    if (!below_) {
+      below_ = true;
+      below_since_ = now;
+    }
+
+    return now - below_since_ >= policy_.grace_period;
+  }
+
+  // accounts for [bytes] transferred and pauses the transfer while its
+  // traffic class is over budget, returns whether it is or was paused
+  bool Throttle(uint64_t bytes) {
+    if (!share_.attached()) return false;
+
+    clock::duration delay = share_.Consume(bytes);
+    if (throttled_) return true;
+    if (delay <= clock::duration::zero()) return false;
+
+    was_throttled_ = true;
+
+    if (driver_ == Driver::Multi) {
+      throttled_ = curl_easy_pause(handle_, CURLPAUSE_ALL) == CURLE_OK;
+      return true;
+    }
+
+    while (delay > clock::duration::zero()) {
+      std::this_thread::sleep_for(
+          std::min<clock::duration>(delay, hold_interval));
+      delay = share_.Consume(0);
+    }
+
+    return true;
+  }
+
+ public:
+  TransferWatch() = default;
+
+  explicit TransferWatch(Driver driver) : driver_{driver} {}
+
+  // whether transfers with [policy] and [track_throughput], [governed] by a
+  // BandwidthGovernor or not, need to be watched
+  static bool Needed(const StallPolicy& policy, bool track_throughput,
+                     bool governed) {
+    return policy.enabled || track_throughput || governed;
+  }
+
+  /**
+   * @brief starts watching the transfer of [handle], throttled by [share] if
+   * it is attached to a governor and calling [forward] with [forward_data]
+   * on every tick if it is not null
+   *
+   */
+  void Start(CURL* handle, const StallPolicy& policy, BandwidthShare share,
+             curl_xferinfo_callback forward, void* forward_data) {
+    *this = TransferWatch{driver_};
+    handle_ = handle;
+    policy_ = policy;
+    share_ = std::move(share);
+    active_ = true;
+    forward_ = forward;
+    forward_data_ = forward_data;
+
+    double time_constant =
+        std::chrono::duration<double>(policy.time_constant).count();
+    receive_ = ThroughputEstimator{time_constant};
+    send_ = ThroughputEstimator{time_constant};
+    last_tick_ = clock::now();
+  }
+
+  // readies the watch for another attempt of the transfer on the same handle
+  void Restart() {
+    receive_.Reset();
+    send_.Reset();
+    received_ = 0;
+    sent_ = 0;
+    last_tick_ = clock::now();
+    receiving_ = false;
+    below_ = false;
+    stalled_ = false;
+    throttled_ = false;
+  }
+
+  // follows the transfer on [handle] from now on, it finished in place of
+  // the one the watch was started on, e.g. a hedge that won
+  void Rebind(CURL* handle) {
+    if (!active_) return;
+    handle_ = handle;
+
+    // its progress was not followed, its rates are its average ones
+    curl_off_t download = 0, upload = 0;
+    curl_easy_getinfo(handle_, CURLINFO_SPEED_DOWNLOAD_T, &download);
+    curl_easy_getinfo(handle_, CURLINFO_SPEED_UPLOAD_T, &upload);
+    receive_.Reset();
+    send_.Reset();
+    receive_.Sample(static_cast<double>(download), 1);
+    send_.Sample(static_cast<double>(upload), 1);
+  }
+
+  // [slot] is marked finished once the transfer is, watched or not
+  void Report(ProgressSlot* slot) { progress_slot_ = slot; }
+
+  // the transfer is driven by [driver] from now on, e.g. a blocking perform
+  // moved onto a multi handle
+  void SetDriver(Driver driver) { driver_ = driver; }
+
+  bool active() const { return active_; }
+
+  bool stalled() const { return stalled_; }
+
+  // whether the transfer is shaped by a BandwidthGovernor
+  bool governed() const { return share_.attached(); }
+
+  bool throttled() const { return throttled_; }
+
+  /**
+   * @brief unpauses the transfer once its traffic class has budget again,
+   * called by the loop driving it. Returns how long until the transfer may be
+   * resumed, clock::duration::max() if it is not paused
+   *
+   * [send_paused] sending stays paused, e.g. while a streamed request body
+   * waits for data
+   */
+  clock::duration ResumeThrottled(bool send_paused = false) {
+    if (!throttled_) return clock::duration::max();
+
+    clock::duration delay = share_.Consume(0);
+    if (delay > clock::duration::zero()) return delay;
+
+    throttled_ = false;
+    curl_easy_pause(handle_, send_paused ? CURLPAUSE_SEND : CURLPAUSE_CONT);
+    return clock::duration::max();
+  }
+
+  Throughput throughput() const {
+    return Throughput{receive_.rate(), send_.rate(), stalled_};
+  }
+
+  /**
+   * @brief adds the average rate of the finished download to its host's
+   * baseline if it succeeded unthrottled, leaves its governor and finishes
+   * its progress slot
+   *
+   */
+  void Finish(StatusCode status) {
+    share_.Release();
+    throttled_ = false;
+
+    if (progress_slot_ != nullptr) progress_slot_->Finish();
+    progress_slot_ = nullptr;
+
+    if (!active_ || !IsOK(status) || was_throttled_) return;
+
+    curl_off_t size = 0, start = 0, total = 0;
+    curl_easy_getinfo(handle_, CURLINFO_SIZE_DOWNLOAD_T, &size);
+    curl_easy_getinfo(handle_, CURLINFO_STARTTRANSFER_TIME_T, &start);
+    curl_easy_getinfo(handle_, CURLINFO_TOTAL_TIME_T, &total);
+
+    if (size < 0 || static_cast<uint64_t>(size) < policy_.minimum_sample_bytes ||
+        total <= start)
+      return;
+
+    baselines().Update(host(), static_cast<double>(size) * 1e6 /
+                                   static_cast<double>(total - start));
+  }
+
+  /**
+   * @brief libcurl transfer info callback with a TransferWatch as its data
+   *
+   */
+  static int Callback(void* data, curl_off_t to_download,
+                      curl_off_t downloaded, curl_off_t to_upload,
+                      curl_off_t uploaded) {
+    TransferWatch* watch = static_cast<TransferWatch*>(data);
+
+    if (watch->forward_ != nullptr) {
+      int result = watch->forward_(watch->forward_data_, to_download,
+                                   downloaded, to_upload, uploaded);
+      if (result != 0) return result;
+    }
+
+    clock::time_point now = clock::now();
+    double seconds =
+        std::chrono::duration<double>(now - watch->last_tick_).count();
+    watch->last_tick_ = now;
+
+    uint64_t received = downloaded < 0 ? 0 : static_cast<uint64_t>(downloaded);
+    uint64_t sent = uploaded < 0 ? 0 : static_cast<uint64_t>(uploaded);
+
+    if (received > 0 && !watch->receiving_) {
+      watch->receiving_ = true;
+      watch->first_byte_ = now;
+    }
+
+    // counts start over when a redirect is followed
+    uint64_t received_delta =
+        received >= watch->received_ ? received - watch->received_ : received;
+    uint64_t sent_delta = sent >= watch->sent_ ? sent - watch->sent_ : sent;
+    watch->received_ = received;
+    watch->sent_ = sent;
+
+    // the receive rate is primed by the first bytes, not by the wait for them
+    if (watch->receiving_) watch->receive_.Sample(received_delta, seconds);
+    watch->send_.Sample(sent_delta, seconds);
+
+    // a transfer held back by its governor is not judged
+    if (watch->Throttle(received_delta + sent_delta)) {
+      watch->below_ = false;
+      return 0;
+    }
+
+    if (watch->Stalled(now, to_download < 0 ? 0 : to_download)) {
+      watch->stalled_ = true;
+      return 1;
+    }
+
+    return 0;
+  }
+
+  TransferWatch(const TransferWatch&) = delete;
+
+  TransferWatch& operator=(const TransferWatch&) = delete;
+
+  TransferWatch(TransferWatch&&) = default;
+
+  TransferWatch& operator=(TransferWatch&&) = default;
+};
+
+};  // namespace swish
+
+#endif
@@ -26,6 +26,7 @@
  */
 
 #include <chrono>
+#include <cmath>
 #include <functional>
 #include <type_traits>
 #include <utility>
@@ -283,6 +284,50 @@ struct TimeRateOp : public std::divides<void> {
   }
 };
 
+/**
+ * @brief Exponentially weighted moving average of a transfer rate, in bytes
+ * per second.
+ *
+ * A sample's weight grows with the time it covers, decaying older samples by
+ * e every [time_constant] seconds, so progress ticks arriving at irregular
+ * intervals are averaged evenly over time rather than per tick.
+ */
+class ThroughputEstimator {
+  double time_constant_ = 1.0;
+  double rate_ = 0.0;
+  bool primed_ = false;
+
+ public:
+  constexpr ThroughputEstimator() = default;
+
+  constexpr explicit ThroughputEstimator(double time_constant)
+      : time_constant_{time_constant} {}
+
+  // [bytes] were transferred over the last [seconds]
+  void Sample(double bytes, double seconds) {
+    if (seconds <= 0) return;
+
+    double rate = bytes / seconds;
+    if (!primed_) {
+      rate_ = rate;
+      primed_ = true;
+      return;
+    }
+
+    rate_ += (1 - std::exp(-seconds / time_constant_)) * (rate - rate_);
+  }
+
+  // smoothed rate, 0 before the first sample
+  double rate() const { return rate_; }
+
+  bool primed() const { return primed_; }
+
+  void Reset() {
+    rate_ = 0.0;
+    primed_ = false;
+  }
+};
+
 template <typename ByteSize_t = int64_t, typename Duration_t = double,
           typename RatioOp_t = std::divides<void>,
           typename ByteSizeDiffOp_t = std::minus<void>,
@@ -316,6 +361,11 @@ std::declval<ratio_op_type>()(
   rate_type receive;
   rate_type send;
 
+  // rates smoothed over the recent samples, far less noisy than the
+  // differentials of [receive] and [send]
+  ThroughputEstimator smoothed_receive{};
+  ThroughputEstimator smoothed_send{};
+
   std::chrono::time_point<std::chrono::high_resolution_clock> last_time_point;
 
   using byte_copy_ref_t = typename logical_copy_reference<byte_size_type>::type;